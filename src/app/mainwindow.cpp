@@ -11,7 +11,7 @@
 
 #include <chrono>
 
-MainWindow::MainWindow(std::shared_ptr<scratcher::bybit::ByBitApi> marketApi, std::shared_ptr<scratcher::AsioScheduler> scheduler, QWidget *parent)
+MainWindow::MainWindow(std::shared_ptr<scratcher::bybit::ByBitApi> marketApi, std::shared_ptr<scratcher::AsioScheduler> scheduler, const std::string& symbol, QWidget *parent)
     : QMainWindow(parent)
     , ui(std::make_unique<Ui::MainWindow>())
     , mMarketApi(std::move(marketApi))
@@ -33,8 +33,12 @@ MainWindow::MainWindow(std::shared_ptr<scratcher::bybit::ByBitApi> marketApi, st
 
     mMarketView->SetMarketData(sample_data);
 
-    mMarketData = scratcher::bybit::ByBitDataManager::Create("BTCUSDC", mMarketApi);
-    mMarketViewController = std::make_shared<scratcher::MarketController>(mMarketView, mMarketData);
+    mMarketData = scratcher::bybit::ByBitDataManager::Create(symbol, mMarketApi);
+    mMarketViewController = scratcher::MarketController::Create(mMarketView, mMarketData);
+
+    // Market state is a lock free snapshot, polling it at the display rate costs next to nothing
+    connect(&mStateTimer, &QTimer::timeout, this, &MainWindow::ShowMarketState);
+    mStateTimer.start(16);
 
 
 
@@ -49,3 +53,16 @@ MainWindow::MainWindow(std::shared_ptr<scratcher::bybit::ByBitApi> marketApi, st
 MainWindow::~MainWindow()
 {
 }
+
+void MainWindow::ShowMarketState()
+{
+    if (mMarketData->StateVersion() == mStateVersion) return;
+
+    mStateVersion = mMarketData->StateVersion();
+    scratcher::MarketState state = mMarketData->State();
+
+    ui->statusbar->showMessage(QString("Bid %1 x %2  Ask %3 x %4  Last %5 x %6 (points)")
+        .arg(state.best_bid.price_points).arg(state.best_bid.volume_points)
+        .arg(state.best_ask.price_points).arg(state.best_ask.volume_points)
+        .arg(state.last_trade_price_points).arg(state.last_trade_volume_points));
+}
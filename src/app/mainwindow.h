@@ -7,6 +7,7 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QTimer>
 
 #include <memory>
 
@@ -39,8 +40,13 @@ class MainWindow : public QMainWindow
     std::shared_ptr<scratcher::bybit::ByBitDataManager> mMarketData;
     std::shared_ptr<scratcher::MarketWidget> mMarketView;
 
+    QTimer mStateTimer;
+    uint64_t mStateVersion = 0;
+
+    void ShowMarketState();
+
 public:
-    MainWindow(std::shared_ptr<scratcher::bybit::ByBitApi> marketApi, std::shared_ptr<scratcher::AsioScheduler> scheduler, QWidget *parent = nullptr);
+    MainWindow(std::shared_ptr<scratcher::bybit::ByBitApi> marketApi, std::shared_ptr<scratcher::AsioScheduler> scheduler, const std::string& symbol, QWidget *parent = nullptr);
     ~MainWindow() override;
 
 
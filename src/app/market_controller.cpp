@@ -5,3 +5,81 @@
 //
 
 #include "market_controller.hpp"
+#include "market_widget.h"
+
+#include <iostream>
+#include <vector>
+
+namespace scratcher {
+
+std::shared_ptr<MarketController> MarketController::Create(std::shared_ptr<MarketWidget> widget, std::shared_ptr<DataProvider> dataProvider)
+{
+    auto self = std::make_shared<MarketController>(widget, dataProvider);
+    self->Subscribe();
+    return self;
+}
+
+void MarketController::Subscribe()
+{
+    // Called on the data provider strand, the candles are taken on the GUI thread
+    mCandles = mDataProvider->Subscribe<Candle>("chart", ConsumerPolicy::LOSSLESS, CANDLE_QUEUE_SIZE, [ref = weak_from_this(), widget = mWidget] {
+        if (auto w = widget.lock()) {
+            QMetaObject::invokeMethod(w.get(), [ref] {
+                if (auto self = ref.lock()) self->HandleCandles();
+            }, Qt::QueuedConnection);
+        }
+    }, true);
+}
+
+void MarketController::HandleCandles()
+{
+    auto widget = mWidget.lock();
+    if (!widget) return;
+
+    if (mCandles->Overflowed()) {
+        // The chart has fallen behind or the provider has reset its data, it is rebuilt from a fresh snapshot
+        std::clog << "chart candle queue overflow or reset, resubscribing" << std::endl;
+        mChart.clear();
+        widget->SetMarketData(std::deque<std::array<double, 4>>{});
+        Subscribe();
+        return;
+    }
+
+    // The widget holds a quote per chart candle, so only the bar being updated and the new ones are passed to it
+    size_t shown = mChart.size();
+    bool last_updated = false;
+    mCandles->Drain([this, shown, &last_updated](const Candle& candle) {
+        if (!mChart.empty() && mChart.back().open_time == candle.open_time) {
+            mChart.back() = candle;
+            if (mChart.size() == shown) last_updated = true;
+        }
+        else if (mChart.empty() || mChart.back().open_time < candle.open_time)
+            mChart.push_back(candle);
+    });
+
+    auto quote = [](const Candle& c) -> std::array<double, 4>
+    { return {double(c.open_points), double(c.high_points), double(c.low_points), double(c.close_points)}; };
+
+    if (shown == 0) {
+        // A snapshot after (re)subscription
+        std::deque<std::array<double, 4>> quotes;
+        for (const auto& c: mChart)
+            quotes.push_back(quote(c));
+        widget->SetMarketData(move(quotes));
+        widget->ResetScale();
+        return;
+    }
+
+    if (last_updated)
+        widget->UpdateLastQuote(quote(mChart[shown - 1]));
+
+    if (mChart.size() > shown) {
+        std::vector<std::array<double, 4>> opened;
+        for (size_t i = shown; i < mChart.size(); ++i)
+            opened.push_back(quote(mChart[i]));
+        widget->AppendMarketData(opened);
+        widget->ResetScale(); // The time scale is shifted once per new candle, not on every trade
+    }
+}
+
+}
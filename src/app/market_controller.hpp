@@ -8,19 +8,32 @@
 #define MARKET_CONTROLLER_HPP
 
 #include <memory>
+#include <deque>
+#include <array>
+
+#include "data_provider.hpp"
 
 namespace scratcher {
 
 class MarketWidget;
-class DataProvider;
 
-class MarketController {
+class MarketController: public std::enable_shared_from_this<MarketController> {
+    static constexpr size_t CANDLE_QUEUE_SIZE = 4096;
+
     std::weak_ptr<MarketWidget> mWidget;
     std::shared_ptr<DataProvider> mDataProvider;
+    std::shared_ptr<EventQueue<Candle>> mCandles;
+
+    std::deque<Candle> mChart; // Accessed on the GUI thread only
+
+    void Subscribe();
+    void HandleCandles();
 public:
     MarketController(std::shared_ptr<MarketWidget> widget, std::shared_ptr<DataProvider> dataProvider)
         : mWidget(move(widget)), mDataProvider(dataProvider)
     {}
+
+    static std::shared_ptr<MarketController> Create(std::shared_ptr<MarketWidget> widget, std::shared_ptr<DataProvider> dataProvider);
 };
 
 }
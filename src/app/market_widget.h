@@ -45,6 +45,9 @@ public:
     void AppendMarketData(const C& newdata)
     { for(const auto& item: newdata) m_quotes.emplace_back(item); update();}
 
+    void UpdateLastQuote(const std::array<double, 4>& quote)
+    { if (!m_quotes.empty()) m_quotes.back() = quote; update(); }
+
     void ResetTimeScale()
     {
         calculateResetTimeScale();
@@ -0,0 +1,154 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+namespace scratcher {
+
+// HDR-style log-linear histogram of durations with nanosecond resolution.
+// Values below 2^SUB_BITS ns are counted exactly, every next power of two is split into
+// 2^(SUB_BITS-1) linear sub-buckets, which keeps relative error of any recorded value below 1/32.
+// Record() is wait-free and may be called concurrently with Snap()/Reset() from other threads.
+class LatencyHistogram
+{
+public:
+    typedef std::chrono::nanoseconds duration;
+
+    static constexpr unsigned SUB_BITS = 6;
+    static constexpr uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS;
+    static constexpr uint64_t HALF_SUB_COUNT = SUB_COUNT / 2;
+    static constexpr size_t BUCKET_COUNT = SUB_COUNT + (64 - SUB_BITS) * HALF_SUB_COUNT;
+
+    static constexpr size_t BucketIndex(uint64_t value)
+    {
+        if (value < SUB_COUNT) return value;
+        unsigned shift = std::bit_width(value) - SUB_BITS;
+        return SUB_COUNT + (shift - 1) * HALF_SUB_COUNT + ((value >> shift) - HALF_SUB_COUNT);
+    }
+
+    // Highest value which is counted in the bucket
+    static constexpr uint64_t BucketValue(size_t index)
+    {
+        if (index < SUB_COUNT) return index;
+        unsigned shift = (index - SUB_COUNT) / HALF_SUB_COUNT + 1;
+        uint64_t mantissa = (index - SUB_COUNT) % HALF_SUB_COUNT + HALF_SUB_COUNT;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    struct Snapshot
+    {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        std::vector<uint64_t> buckets;
+
+        uint64_t Count() const
+        { return count; }
+        duration Min() const
+        { return duration(min); }
+        duration Max() const
+        { return duration(max); }
+        duration Mean() const
+        { return duration(count ? sum / count : 0); }
+
+        duration Percentile(double percent) const
+        {
+            if (!count) return duration(0);
+
+            uint64_t rank = static_cast<uint64_t>(percent / 100.0 * count + 0.5);
+            if (rank == 0) rank = 1;
+            if (rank > count) rank = count;
+
+            uint64_t acc = 0;
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                acc += buckets[i];
+                if (acc >= rank)
+                    return duration(std::min(BucketValue(i), max));
+            }
+            return duration(max);
+        }
+    };
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets = {};
+    std::atomic<uint64_t> m_count = 0;
+    std::atomic<uint64_t> m_sum = 0;
+    std::atomic<uint64_t> m_min = std::numeric_limits<uint64_t>::max();
+    std::atomic<uint64_t> m_max = 0;
+
+public:
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    // Negative durations (i.e. clock offset estimation error) are counted as zero
+    void Record(duration d)
+    {
+        uint64_t value = d.count() > 0 ? static_cast<uint64_t>(d.count()) : 0;
+
+        m_buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t cur = m_min.load(std::memory_order_relaxed);
+        while (value < cur && !m_min.compare_exchange_weak(cur, value, std::memory_order_relaxed)) ;
+        cur = m_max.load(std::memory_order_relaxed);
+        while (value > cur && !m_max.compare_exchange_weak(cur, value, std::memory_order_relaxed)) ;
+
+        m_count.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t Count() const
+    { return m_count.load(std::memory_order_acquire); }
+
+    Snapshot Snap() const
+    {
+        Snapshot snap;
+        snap.buckets.resize(BUCKET_COUNT);
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            snap.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+            snap.count += snap.buckets[i];
+        }
+        snap.sum = m_sum.load(std::memory_order_relaxed);
+        snap.min = snap.count ? m_min.load(std::memory_order_relaxed) : 0;
+        snap.max = m_max.load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    void Reset()
+    {
+        for (auto& b: m_buckets) b.store(0, std::memory_order_relaxed);
+        m_sum.store(0, std::memory_order_relaxed);
+        m_min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+        m_max.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_release);
+    }
+};
+
+inline std::ostream& operator<< (std::ostream& s, const LatencyHistogram::Snapshot& h)
+{
+    auto us = [](LatencyHistogram::duration d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+    return s << "n=" << h.Count()
+             << " min=" << us(h.Min()) << "us"
+             << " p50=" << us(h.Percentile(50)) << "us"
+             << " p99=" << us(h.Percentile(99)) << "us"
+             << " p99.9=" << us(h.Percentile(99.9)) << "us"
+             << " max=" << us(h.Max()) << "us";
+}
+
+}
+
+#endif //LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,106 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef SEQLOCK_HPP
+#define SEQLOCK_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+namespace scratcher {
+
+// Single writer / many readers publication of a small trivially copyable value.
+// The writer never waits, a reader retries only if it has raced with a write.
+// The payload is kept in relaxed atomic words, so concurrent copy is not a data race,
+// and the layout is plain 64-bit words which makes it usable in shared memory as well.
+template <typename T>
+requires std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>
+class Seqlock
+{
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint64_t> m_seq = 0;
+    std::array<std::atomic<uint64_t>, WORDS> m_data = {};
+
+public:
+    Seqlock() = default;
+    explicit Seqlock(const T& value)
+    { Store(value); }
+
+    Seqlock(const Seqlock&) = delete;
+    Seqlock& operator=(const Seqlock&) = delete;
+
+    // Must not be called concurrently with another Store()
+    void Store(const T& value)
+    {
+        uint64_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        uint64_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; ++i)
+            m_data[i].store(words[i], std::memory_order_relaxed);
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Stores the given byte ranges of the value only, {offset, size} each, the other words keep what they had.
+    // Lets the writer skip the unused tail of a fixed layout. Must not be called concurrently with another Store()
+    void Store(const T& value, std::initializer_list<std::pair<size_t, size_t>> ranges)
+    {
+        const char* bytes = reinterpret_cast<const char*>(&value);
+
+        uint64_t seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (auto [offset, size]: ranges) {
+            size_t end = std::min(offset + size, sizeof(T));
+            for (size_t i = offset / sizeof(uint64_t); i * sizeof(uint64_t) < end; ++i) {
+                uint64_t word = 0;
+                std::memcpy(&word, bytes + i * sizeof(uint64_t), std::min(sizeof(uint64_t), sizeof(T) - i * sizeof(uint64_t)));
+                m_data[i].store(word, std::memory_order_relaxed);
+            }
+        }
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    T Load() const
+    {
+        uint64_t words[WORDS];
+        for (;;) {
+            uint64_t seq = m_seq.load(std::memory_order_acquire);
+            if (seq & 1) continue;
+
+            for (size_t i = 0; i < WORDS; ++i)
+                words[i] = m_data[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_seq.load(std::memory_order_relaxed) == seq) break;
+        }
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+    // Number of Store() calls so far, lets a poller skip Load() when nothing has changed
+    uint64_t Version() const
+    { return m_seq.load(std::memory_order_acquire) / 2; }
+};
+
+}
+
+#endif //SEQLOCK_HPP
@@ -0,0 +1,56 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef STARTUP_TIMELINE_HPP
+#define STARTUP_TIMELINE_HPP
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace scratcher {
+
+// Times of the startup steps since the timeline has been created, in the order they have completed.
+// Only the first completion of a step is kept, so the steps repeated on reconnect do not move it.
+// Mark() may be called from any thread.
+class StartupTimeline
+{
+public:
+    typedef std::chrono::steady_clock clock;
+    typedef std::pair<std::string, clock::duration> mark_type;
+
+private:
+    const clock::time_point m_start = clock::now();
+
+    mutable std::mutex m_mutex;
+    std::vector<mark_type> m_marks;
+
+public:
+    void Mark(std::string step)
+    {
+        auto elapsed = clock::now() - m_start;
+        {
+            std::unique_lock lock(m_mutex);
+            for (const auto& mark: m_marks)
+                if (mark.first == step) return;
+            m_marks.emplace_back(step, elapsed);
+        }
+        std::clog << "Startup: " << step << " in " << std::chrono::duration_cast<std::chrono::microseconds>(elapsed) << std::endl;
+    }
+
+    std::vector<mark_type> Marks() const
+    {
+        std::unique_lock lock(m_mutex);
+        return m_marks;
+    }
+};
+
+}
+
+#endif //STARTUP_TIMELINE_HPP
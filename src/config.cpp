@@ -17,12 +17,37 @@ const char * const DATADIR = "--data-dir,-d";
 const char * const VERBOSE = "--verbose,-v";
 const char * const TRACE = "--debug-trace,-t";
 
+const char* const THREADS = "--threads";
+const char* const THREAD_PER_CORE = "--thread-per-core";
+const char* const CPUS = "--cpus";
+const char* const COMPUTE_THREADS = "--compute-threads";
+const char* const COMPUTE_CPUS = "--compute-cpus";
+const char* const SYMBOLS = "--symbols";
+const char* const METRICS_INTERVAL = "--metrics-interval";
+const char* const RECORD = "--record";
+const char* const JOURNAL_COMPRESS = "--journal-compress";
+const char* const REPLAY = "--replay";
+const char* const REPLAY_FAST = "--replay-fast";
+
 const char* const BYBIT = "bybit";
 
 const char* const HTTP_HOST = "--http-host";
 const char* const HTTP_PORT = "--http-port";
 const char* const STREAM_HOST = "--stream-host";
 const char* const STREAM_PORT = "--stream-port";
+const char* const STREAM_PING_INTERVAL = "--stream-ping-interval";
+const char* const CLOCK_SYNC_INTERVAL = "--clock-sync-interval";
+const char* const DNS_REFRESH_INTERVAL = "--dns-refresh-interval";
+const char* const CONNECT_STAGGER = "--connect-stagger";
+
+const char* const NO_DELAY = "--tcp-nodelay";
+const char* const RECEIVE_BUFFER = "--so-rcvbuf";
+const char* const SEND_BUFFER = "--so-sndbuf";
+const char* const BUSY_POLL = "--so-busy-poll";
+const char* const QUICK_ACK = "--tcp-quickack";
+const char* const RX_TIMESTAMPS = "--rx-timestamps";
+const char* const SHARED_BOOK_DEPTH = "--shared-book-depth";
+const char* const CAPTURE = "--capture";
 }
 Config::Config(int argc, const char *const argv[])
 {
@@ -61,11 +86,37 @@ Config::Config(int argc, const char *const argv[])
     mApp.add_option(DATADIR, mDataDir, "Directory path to store wallet data")->default_val(home/".scratcher")->configurable(false);
     mApp.add_flag(TRACE, mTrace, "Print debug traces to log");
 
+    mApp.add_option(THREADS, m_threads, "Number of I/O threads")->default_val(2)->check(CLI::PositiveNumber)->configurable(true);
+    mApp.add_flag(THREAD_PER_CORE, m_thread_per_core, "Run a separate I/O context on each thread instead of sharing one")->configurable(true);
+    mApp.add_option(CPUS, m_cpus, "Comma separated CPUs to pin I/O threads to, in thread order (Linux only)")->delimiter(',')->configurable(true);
+    mApp.add_option(COMPUTE_THREADS, m_compute_threads, "Number of analytics compute threads")->default_val(1)->check(CLI::PositiveNumber)->configurable(true);
+    mApp.add_option(COMPUTE_CPUS, m_compute_cpus, "Comma separated CPUs to pin compute threads to (Linux only)")->delimiter(',')->configurable(true);
+    mApp.add_option(SYMBOLS, m_symbols, "Comma separated instrument symbols to follow, the GUI shows the first one")->delimiter(',')->capture_default_str()->configurable(true);
+    mApp.add_option(METRICS_INTERVAL, m_metrics_interval_s, "Interval to log pipeline metrics in headless mode, s")->default_val(60)->configurable(true);
+    mApp.add_flag(RECORD, m_record, "Record trades and order book updates to the journal in the data directory (headless mode)")->configurable(true);
+    mApp.add_flag(JOURNAL_COMPRESS, m_journal_compress, "Compress journal segments of the passed days")->configurable(true);
+    mApp.add_option(REPLAY, m_replay_file, "Replay a frame capture file instead of connecting to the exchange (headless mode)")->check(CLI::ExistingFile);
+    mApp.add_flag(REPLAY_FAST, m_replay_fast, "Replay frames as fast as possible instead of the captured pace");
+
     auto bybit = mApp.add_subcommand(BYBIT, "ByBit exchange options")->configurable()->group("Configb File Sections");
     bybit->add_option(HTTP_HOST, m_http_host, "ByBit exchange HTTP API host")->configurable(true);
     bybit->add_option(HTTP_PORT, m_http_port, "ByBit exchange HTTP API port")->configurable(true);
     bybit->add_option(STREAM_HOST, m_stream_host, "ByBit exchange web-socket stream API host")->configurable(true);
     bybit->add_option(STREAM_PORT, m_stream_port, "ByBit exchange web-socket stream API port")->configurable(true);
+    bybit->add_option(STREAM_PING_INTERVAL, m_stream_ping_interval_ms, "ByBit web-socket stream ping (round trip probe) interval, ms (1000 - 3600000)")->default_val(20000)->check(CLI::Range(1000, 3600000))->configurable(true);
+    bybit->add_option(CLOCK_SYNC_INTERVAL, m_clock_sync_interval_s, "ByBit server clock synchronization interval, s")->default_val(30)->check(CLI::PositiveNumber)->configurable(true);
+    bybit->add_option(DNS_REFRESH_INTERVAL, m_dns_refresh_interval_s, "Interval to resolve the exchange hosts again in background, s (0 - resolve once)")->default_val(300)->configurable(true);
+    bybit->add_option(CONNECT_STAGGER, m_connect_stagger_ms, "Delay before connecting to the next resolved address in parallel, ms (0 - connect to all at once)")->default_val(250)->configurable(true);
+
+    bybit->add_option(NO_DELAY, m_socket_options.tcp_nodelay, "Disable Nagle algorithm on exchange connections")->default_val(true)->configurable(true);
+    bybit->add_option(RECEIVE_BUFFER, m_socket_options.receive_buffer, "Socket receive buffer size, bytes (0 - system default)")->default_val(0)->configurable(true);
+    bybit->add_option(SEND_BUFFER, m_socket_options.send_buffer, "Socket send buffer size, bytes (0 - system default)")->default_val(0)->configurable(true);
+    bybit->add_option(BUSY_POLL, m_socket_options.busy_poll, "Socket busy poll time, us (0 - disabled, Linux only)")->default_val(0)->configurable(true);
+    bybit->add_option(QUICK_ACK, m_socket_options.tcp_quickack, "Send TCP ACKs immediately (Linux only)")->default_val(false)->configurable(true);
+    bybit->add_option(RX_TIMESTAMPS, m_socket_options.rx_timestamps, "Take kernel receive timestamps of stream data (Linux only)")->default_val(false)->configurable(true);
+
+    bybit->add_option(SHARED_BOOK_DEPTH, m_shared_book_depth, "Order book levels to mirror into shared memory /scratcher.<symbol>.book (0 - disabled)")->default_val(0)->check(CLI::Range(0, 50))->configurable(true);
+    bybit->add_option(CAPTURE, m_capture_file, "File to capture raw public stream frames to, for replay")->configurable(true);
 
     try {
         mApp.parse(argc, argv);
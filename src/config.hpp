@@ -18,11 +18,32 @@ class Config : public scratcher::bybit::Config{
 
     std::string mDataDir;
 
+    size_t m_threads;
+    bool m_thread_per_core;
+    std::vector<int> m_cpus;
+    size_t m_compute_threads;
+    std::vector<int> m_compute_cpus;
+
+    std::vector<std::string> m_symbols {"BTCUSDC"};
+    size_t m_metrics_interval_s;
+    bool m_record;
+    bool m_journal_compress;
+    std::string m_replay_file;
+    bool m_replay_fast;
+
     std::string m_http_host;
     std::string m_http_port;
 
     std::string m_stream_host;
     std::string m_stream_port;
+    size_t m_stream_ping_interval_ms;
+    size_t m_clock_sync_interval_s;
+    size_t m_dns_refresh_interval_s;
+    size_t m_connect_stagger_ms;
+
+    scratcher::SocketOptions m_socket_options;
+    size_t m_shared_book_depth;
+    std::string m_capture_file;
 
 public:
     Config() = delete;
@@ -30,13 +51,36 @@ public:
 
     size_t Verbose() const { return mVerbose; }
     bool Trace() const {return mTrace; }
-    const std::string& DataDir() const { return mDataDir; }
+    const std::string& DataDir() const override { return mDataDir; }
+
+    size_t Threads() const { return m_threads; }
+    bool ThreadPerCore() const { return m_thread_per_core; }
+    const std::vector<int>& Cpus() const { return m_cpus; }
+    size_t ComputeThreads() const { return m_compute_threads; }
+    const std::vector<int>& ComputeCpus() const { return m_compute_cpus; }
+
+    const std::vector<std::string>& Symbols() const { return m_symbols; }
+    std::chrono::seconds MetricsInterval() const { return std::chrono::seconds(m_metrics_interval_s); }
+    bool Record() const { return m_record; }
+    bool JournalCompress() const { return m_journal_compress; }
+    const std::string& ReplayFile() const { return m_replay_file; }
+    bool ReplayFast() const { return m_replay_fast; }
 
     const std::string& HttpHost() const override { return m_http_host; }
     const std::string& HttpPort() const override { return m_http_port; }
 
     const std::string& StreamHost() const override { return m_stream_host; }
     const std::string& StreamPort() const override { return m_stream_port; }
+    std::chrono::milliseconds StreamPingInterval() const override { return std::chrono::milliseconds(m_stream_ping_interval_ms); }
+
+    std::chrono::seconds ClockSyncInterval() const override { return std::chrono::seconds(m_clock_sync_interval_s); }
+    std::chrono::seconds DnsRefreshInterval() const override { return std::chrono::seconds(m_dns_refresh_interval_s); }
+    std::chrono::milliseconds ConnectStagger() const override { return std::chrono::milliseconds(m_connect_stagger_ms); }
+
+    const scratcher::SocketOptions& SocketTuning() const override { return m_socket_options; }
+
+    size_t SharedBookDepth() const override { return m_shared_book_depth; }
+    const std::string& CaptureFile() const override { return m_capture_file; }
 };
 
 
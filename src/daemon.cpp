@@ -0,0 +1,189 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+// Headless market data recorder: follows the configured symbols and logs the pipeline metrics periodically.
+// With --replay it feeds a frame capture through the same pipeline instead and exits when the capture ends.
+
+#include "config.hpp"
+
+#include "scheduler.hpp"
+#include "bybit.hpp"
+#include "bybit/data_manager.hpp"
+#include "bybit/capture.hpp"
+#include "journal.hpp"
+
+#include <csignal>
+#include <iostream>
+#include <map>
+
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/detached.hpp>
+
+namespace {
+
+using namespace scratcher;
+
+const char* const POLICY_NAMES[] = {"lossless", "conflate", "drop"};
+
+void LogMetrics(bybit::ByBitApi& api, const std::map<std::string, std::shared_ptr<bybit::ByBitDataManager>>& managers, const TickJournal* journal)
+{
+    if (auto offset = api.ServerTimeOffset())
+        std::clog << "Server time offset: " << std::chrono::duration_cast<std::chrono::microseconds>(*offset) << std::endl;
+    if (auto marks = api.Startup().Marks(); !marks.empty()) {
+        std::clog << "Startup steps:";
+        for (const auto& [step, elapsed]: marks)
+            std::clog << ' ' << step << ' ' << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed) << ';';
+        std::clog << std::endl;
+    }
+    for (const auto& [name, pool]: {std::pair<const char*, const EndpointPool&>{"http", api.HttpEndpoints()}, {"stream", api.StreamEndpoints()}}) {
+        for (const auto& e: pool.Stats()) {
+            std::clog << name << " endpoint " << e.endpoint << " connects: " << e.connects << " failures: " << e.failures;
+            if (e.connect_latency)
+                std::clog << " connect latency: " << std::chrono::duration_cast<std::chrono::microseconds>(*e.connect_latency);
+            std::clog << std::endl;
+        }
+    }
+    if (auto rtt = api.PublicStreamRoundTrip())
+        std::clog << "Public stream round trip: " << *rtt << std::endl;
+    if (auto decode = api.PublicStreamDecodeLatency())
+        std::clog << "Public stream decode latency: " << *decode << std::endl;
+    if (auto reads = api.PublicStreamReadsPerFrame())
+        std::clog << "Public stream reads per frame: " << *reads << std::endl;
+
+    for (const auto& [symbol, manager]: managers) {
+        for (const char* topic: {"publicTrade", "orderbook"}) {
+            if (auto latency = api.FeedLatency(symbol, topic))
+                std::clog << symbol << ' ' << topic << " feed latency: " << *latency << std::endl;
+        }
+
+        MarketState state = manager->State();
+        std::clog << symbol << " bid: " << state.best_bid.price_points << " ask: " << state.best_ask.price_points
+                  << " book update: " << state.book_update_id << " last trade: " << state.last_trade_price_points << std::endl;
+
+        for (const auto& consumer: manager->Consumers()) {
+            std::clog << symbol << " consumer " << consumer.name << " (" << POLICY_NAMES[static_cast<size_t>(consumer.policy)] << ")"
+                      << " delivered: " << consumer.delivered << " dropped: " << consumer.dropped
+                      << " backlog: " << consumer.backlog << '/' << consumer.max_backlog
+                      << (consumer.overflowed ? " overflowed" : "") << " lag: " << consumer.lag << std::endl;
+        }
+
+        // Only the latest value of each indicator is reported
+        std::map<uint32_t, AnalyticsResult> analytics;
+        for (AnalyticsResult result; manager->PopAnalyticsResult(result); )
+            analytics[result.indicator] = result;
+        if (auto it = analytics.find(bybit::ByBitDataManager::VWAP_1H); it != analytics.end())
+            std::clog << symbol << " 1h VWAP (points): " << it->second.value << std::endl;
+        if (auto dropped = manager->AnalyticsDropped())
+            std::clog << symbol << " analytics results dropped: " << dropped << std::endl;
+    }
+
+    if (auto captured = api.CapturedFrames())
+        std::clog << "Captured frames: " << *captured << " dropped: " << api.CaptureDropped().value_or(0) << std::endl;
+
+    if (journal) {
+        JournalStats stats = journal->Stats();
+        std::clog << "Journal records: " << stats.records << " bytes: " << stats.bytes << " batches: " << stats.batches
+                  << " gaps: " << stats.gaps << " errors: " << stats.errors << " compressed: " << stats.compressed << std::endl;
+    }
+}
+
+boost::asio::awaitable<void> ReportMetrics(std::shared_ptr<bybit::ByBitApi> api,
+                                           const std::map<std::string, std::shared_ptr<bybit::ByBitDataManager>>& managers,
+                                           const TickJournal* journal, std::chrono::seconds interval)
+{
+    boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor);
+    for (;;) {
+        timer.expires_after(interval);
+        co_await timer.async_wait(boost::asio::use_awaitable);
+        LogMetrics(*api, managers, journal);
+    }
+}
+
+boost::asio::awaitable<void> RunReplay(std::shared_ptr<bybit::ByBitApi> api, std::filesystem::path path, bybit::FrameReplay::Pace pace,
+                                       const std::map<std::string, std::shared_ptr<bybit::ByBitDataManager>>& managers,
+                                       const TickJournal* journal)
+{
+    try {
+        bybit::FrameReplay replay(path);
+        co_await replay.Run(api, pace);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(replay.Elapsed());
+        std::clog << "Replayed " << replay.Frames() << " frames in " << elapsed.count() << "s";
+        if (elapsed.count() > 0)
+            std::clog << " (" << static_cast<uint64_t>(replay.Frames() / elapsed.count()) << " frames/s)";
+        std::clog << std::endl;
+    }
+    catch (std::exception& e) {
+        std::cerr << "Replay error: " << e.what() << std::endl;
+    }
+    LogMetrics(*api, managers, journal);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    try {
+        auto config = std::make_shared<Config>(argc, argv);
+
+        auto scheduler = config->ThreadPerCore()
+            ? scratcher::AsioScheduler::CreatePerCore(config->Threads(), config->Cpus())
+            : scratcher::AsioScheduler::Create(config->Threads(), config->Cpus());
+        scheduler->StartCompute(config->ComputeThreads(), config->ComputeCpus());
+
+        bool replay = !config->ReplayFile().empty();
+        auto bybit = replay ? scratcher::bybit::ByBitApi::CreateOffline(config, scheduler)
+                            : scratcher::bybit::ByBitApi::Create(config, scheduler);
+
+        std::map<std::string, std::shared_ptr<scratcher::bybit::ByBitDataManager>> managers;
+        for (const auto& symbol: config->Symbols())
+            managers.try_emplace(symbol, scratcher::bybit::ByBitDataManager::Create(symbol, bybit));
+
+        std::unique_ptr<scratcher::TickJournal> journal;
+        if (config->Record()) {
+            journal = std::make_unique<scratcher::TickJournal>(std::filesystem::path(config->DataDir()) / "journal", config->JournalCompress());
+            for (const auto& [symbol, manager]: managers)
+                journal->Record(symbol, manager);
+        }
+
+        // The main thread only waits for a signal and reports metrics, the pipeline runs on the scheduler threads
+        boost::asio::io_context io;
+        boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+        signals.async_wait([&io](boost::system::error_code ec, int signal) {
+            if (!ec) std::clog << "Signal " << signal << " received, stopping" << std::endl;
+            io.stop();
+        });
+
+        if (config->MetricsInterval().count())
+            boost::asio::co_spawn(io, ReportMetrics(bybit, managers, journal.get(), config->MetricsInterval()), boost::asio::detached);
+
+        if (replay) {
+            auto pace = config->ReplayFast() ? scratcher::bybit::FrameReplay::Pace::FAST : scratcher::bybit::FrameReplay::Pace::ORIGINAL;
+            boost::asio::co_spawn(io, RunReplay(bybit, config->ReplayFile(), pace, managers, journal.get()),
+                                  [&io](std::exception_ptr) { io.stop(); });
+        }
+
+        io.run();
+        return 0;
+    }
+    catch(std::system_error& e) {
+        std::cerr << "System error: " << e.what() << " ("  << e.code() << ')' << std::endl;
+        return -1;
+    }
+    catch(boost::system::system_error& e) {
+        std::cerr << "System error: " << e.what() << " ("  << e.code() << ')' << std::endl;
+        return -1;
+    }
+    catch(std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    catch(...) {
+        std::cerr << "Unknown error" << std::endl;
+        return -1;
+    }
+}
@@ -0,0 +1,59 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef ASYNC_EVENT_HPP
+#define ASYNC_EVENT_HPP
+
+#include <atomic>
+
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace scratcher {
+
+// Manual-reset event for coroutines: waiters are parked on a timer which never expires
+// and all of them are released at once when the event is set.
+// Wait/Set/Reset must be called from the executor (strand) the event is constructed with.
+class AsyncEvent
+{
+    boost::asio::steady_timer m_timer;
+    std::atomic<bool> m_set = false;
+public:
+    template <typename Executor>
+    explicit AsyncEvent(const Executor& executor)
+        : m_timer(executor, boost::asio::steady_timer::time_point::max())
+    {}
+
+    bool IsSet() const
+    { return m_set; }
+
+    void Set()
+    {
+        m_set = true;
+        m_timer.cancel();
+    }
+
+    void Reset()
+    {
+        m_set = false;
+        m_timer.expires_at(boost::asio::steady_timer::time_point::max());
+    }
+
+    boost::asio::awaitable<void> Wait()
+    {
+        if (m_set) co_return;
+
+        boost::system::error_code ec;
+        co_await m_timer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+        // operation_aborted is the normal wake-up reason here
+    }
+};
+
+}
+
+#endif //ASYNC_EVENT_HPP
@@ -14,13 +14,20 @@
 #include <boost/lexical_cast.hpp>
 
 
+#include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstring>
 #include <sstream>
 
 #include "bybit/error.hpp"
+#include "bybit/http_session.hpp"
 #include "bybit/stream.hpp"
 #include "bybit/subscription.hpp"
 #include "bybit/data_manager.hpp"
+#include "bybit/capture.hpp"
+#include "bybit/instrument_cache.hpp"
+#include "bybit/instrument_catalogue.hpp"
 
 namespace scratcher::bybit {
 
@@ -32,6 +39,30 @@ const char* const REQ_KLINE = "/v5/market/kline";
 
 const char* const STREAM_PUBLIC_SPOT = "/v5/public/spot";
 
+const size_t CLOCK_SYNC_BURST = 4;
+
+const size_t CATALOGUE_PAGE_SIZE = 1000; // ByBit maximum
+const size_t CATALOGUE_MAX_PAGES = 100;
+const std::chrono::minutes CATALOGUE_MAX_AGE(10);
+const size_t LOG_BODY_MAX = 512; // Longer response bodies such as catalogue pages are cut in the log
+
+std::string UrlEncode(std::string_view str)
+{
+    static const char* const HEX = "0123456789ABCDEF";
+    std::string res;
+    res.reserve(str.size());
+    for (char c: str) {
+        if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.' || c == '~')
+            res += c;
+        else {
+            res += '%';
+            res += HEX[static_cast<unsigned char>(c) >> 4];
+            res += HEX[static_cast<unsigned char>(c) & 0xf];
+        }
+    }
+    return res;
+}
+
 std::string generateSignature(const std::string &message, const std::string &secret)
 {
     unsigned char* digest = HMAC(EVP_sha256(), secret.c_str(), secret.length(), (unsigned char*)message.c_str(), message.length(), NULL, NULL);
@@ -55,97 +86,109 @@ bybit_error_category_impl bybit_error_category_impl::instance;
 ByBitApi::ByBitApi(std::shared_ptr<Config> config, std::shared_ptr<AsioScheduler> scheduler)
     : mConfig(move(config))
     , mScheduler(std::move(scheduler))
-    , m_data_queue(10)
-    , m_data_queue_strand(make_strand(mScheduler->io()))
+    , m_startup_strand(make_strand(mScheduler->io().get_executor()))
+    , m_http_host_resolved(m_startup_strand)
+    , m_websock_host_resolved(m_startup_strand)
+    , m_public_stream_shard(mScheduler->ShardFor(STREAM_PUBLIC_SPOT))
+    , m_catalogue_strand(make_strand(mScheduler->io().get_executor()))
+    , m_catalogue_ready(m_catalogue_strand)
 {
+    if (!mConfig->CaptureFile().empty())
+        m_capture = std::make_shared<FrameCapture>(mConfig->CaptureFile());
 }
 
 std::shared_ptr<ByBitApi> ByBitApi::Create(std::shared_ptr<Config> config, std::shared_ptr<AsioScheduler> scheduler)
 {
     auto self = std::make_shared<ByBitApi>(config, scheduler);
     std::weak_ptr ref{self};
+    if (!config->DataDir().empty())
+        self->m_instrument_cache = std::make_shared<InstrumentCache>(std::filesystem::path(config->DataDir()) / "bybit" / "instruments.json", scheduler);
     self->Resolve();
-    //self->Spawn([ref](yield_context yield) { if (auto self = ref.lock()) self->DoPing(yield); });
+    self->SpawnClockSync();
+    //self->Spawn([ref]() -> awaitable<void> { if (auto self = ref.lock()) co_await self->DoPing(); });
+
+    return self;
+}
 
+std::shared_ptr<ByBitApi> ByBitApi::CreateOffline(std::shared_ptr<Config> config, std::shared_ptr<AsioScheduler> scheduler)
+{
+    auto self = std::make_shared<ByBitApi>(config, scheduler);
+    self->m_offline = true;
     return self;
 }
 
 
-void ByBitApi::Spawn(std::function<void(yield_context yield)> task)
+void ByBitApi::Spawn(std::function<awaitable<void>()> task)
 {
-    spawn(mScheduler->io(),
-        [ref = weak_from_this(), task](yield_context yield) {
-            boost::system::error_code status;
-            while (true) {
-                try {
-                    task(yield[status]);
-                    if (status)
-                        throw status;
+    Spawn(mScheduler->io().get_executor(), move(task));
+}
 
-                    return;
+void ByBitApi::Spawn(boost::asio::any_io_executor executor, std::function<awaitable<void>()> task)
+{
+    co_spawn(executor,
+        [ref = weak_from_this(), task = move(task)]() -> awaitable<void> {
+            for (;;) {
+                try {
+                    co_await task();
+                    co_return;
                 }
                 catch (boost::system::error_code &e) {
-                    std::cerr << "Error: " << e.what() << std::endl;
+                    std::cerr << "Error: " << e.message() << std::endl;
                 }
                 catch (std::exception& e) {
                     std::cerr << "Error: " << e.what() << std::endl;
                 }
 
-                if (auto self = ref.lock()) {
-                    boost::system::error_code timer_error;
-                    boost::asio::steady_timer t(yield.get_executor(), milliseconds(500));
-                    t.async_wait(yield[timer_error]);
+                if (ref.expired()) co_return;
 
-                    if (timer_error) {
-                        std::cerr << "Repeat timer error: " << timer_error.message() << std::endl;
-                        throw status;
-                    }
+                boost::system::error_code timer_error;
+                boost::asio::steady_timer t(co_await boost::asio::this_coro::executor, milliseconds(500));
+                co_await t.async_wait(redirect_error(use_awaitable, timer_error));
+
+                if (timer_error) {
+                    std::cerr << "Repeat timer error: " << timer_error.message() << std::endl;
+                    throw timer_error;
                 }
             }
         },
         [](std::exception_ptr ex) { if (ex) std::rethrow_exception(ex); });
 }
 
-nlohmann::json ByBitApi::DoRequestServer(std::string_view request_string, yield_context &yield)
+awaitable<nlohmann::json> ByBitApi::DoRequestServer(std::string request_string)
 {
-    if (m_resolved_http_host.empty()) throw xscratcher_error_code(error::no_host_name);
-
-    boost::system::error_code error;
-    boost::beast::ssl_stream<boost::beast::tcp_stream> sock(mScheduler->io(), mScheduler->ssl());
-
-    auto start_time = std::chrono::utc_clock::now();
-
-    get_lowest_layer(sock).async_connect(m_resolved_http_host, yield[error]);
-    if (error) throw error;
-
-    if (!SSL_set_tlsext_host_name(sock.native_handle(), mConfig->HttpHost().c_str()))
-        throw std::ios_base::failure( "Failed to set SNI Hostname");
-
-    sock.async_handshake(ssl::stream_base::client, yield[error]);
-    if (error) throw error;
+    co_await WaitHttpHost();
 
-    boost::beast::http::request<boost::beast::http::string_body> req(boost::beast::http::verb::get, request_string, 11);
-    req.set(boost::beast::http::field::host, mConfig->HttpHost());
-    req.prepare_payload();
+    HttpSession session(mScheduler->io().get_executor(), mScheduler->ssl(), mConfig->HttpHost(), mConfig->SocketTuning());
+    co_await session.Connect(m_http_endpoints, mConfig->ConnectStagger());
 
-    boost::beast::http::async_write(sock, req, yield[error]);
-    if (error) throw error;
+    co_return co_await DoRequestServer(session, move(request_string));
+}
 
-    boost::beast::flat_buffer buf;
-    boost::beast::http::response<boost::beast::http::string_body> resp;
-    boost::beast::http::async_read(sock, buf, resp, yield[error]);
-    if (error) throw error;
+awaitable<nlohmann::json> ByBitApi::DoRequestServer(HttpSession& session, std::string request_string)
+{
+    auto resp = co_await session.Request(move(request_string));
 
-    if (resp.result() == boost::beast::http::status::ok) {
-        std::clog << "resp body: " << resp.body() << std::endl;
-        auto resp_json = nlohmann::json::parse(resp.body().begin(), resp.body().end());
+    if (resp.message.result() == boost::beast::http::status::ok) {
+        const auto& body = resp.message.body();
+        if (body.size() <= LOG_BODY_MAX)
+            std::clog << "resp body: " << body << std::endl;
+        else
+            std::clog << "resp body: " << std::string_view(body).substr(0, LOG_BODY_MAX) << "... (" << body.size() << " bytes)" << std::endl;
+        auto resp_json = nlohmann::json::parse(resp.message.body().begin(), resp.message.body().end());
 
         if (resp_json["retCode"] == 0) {
-            auto end_time = std::chrono::utc_clock::now();
-            std::chrono::utc_clock::time_point server_time = std::chrono::time_point<std::chrono::utc_clock>(milliseconds(resp_json["time"].get<long>()));
-            CalcServerTime(server_time, start_time, end_time);
+            // ByBit reports Unix time which is system_clock epoch, utc_clock would count leap seconds in addition
+            if (resp_json.contains("result") && resp_json["result"].contains("timeNano")) {
+                std::chrono::system_clock::time_point server_time(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds(boost::lexical_cast<int64_t>(resp_json["result"]["timeNano"].get<std::string>()))));
+                m_clock_sync.AddSample(resp.sent, server_time, resp.received, std::chrono::microseconds(1));
+            }
+            else if (resp_json.contains("time")) {
+                std::chrono::system_clock::time_point server_time(milliseconds(resp_json["time"].get<long>()));
+                m_clock_sync.AddSample(resp.sent, server_time, resp.received, milliseconds(1));
+            }
 
-            return resp_json;
+            co_return resp_json;
         }
         else {
             std::cerr << "bybit returned error: " << resp_json["retMsg"] << std::endl;
@@ -153,8 +196,41 @@ nlohmann::json ByBitApi::DoRequestServer(std::string_view request_string, yield_
         }
     }
     else {
-        std::cerr << "http returned error: " << resp.reason() << std::endl;
-        throw boost::system::error_code(resp.result_int(), bybit_error_category());
+        std::cerr << "http returned error: " << resp.message.reason() << std::endl;
+        throw boost::system::error_code(resp.message.result_int(), bybit_error_category());
+    }
+}
+
+void ByBitApi::SpawnClockSync()
+{
+    auto session = std::make_shared<HttpSession>(mScheduler->io().get_executor(), mScheduler->ssl(), mConfig->HttpHost(), mConfig->SocketTuning());
+    auto interval = mConfig->ClockSyncInterval();
+
+    Spawn([ref = weak_from_this(), session, interval]() -> awaitable<void> {
+        for (;;) {
+            if (auto self = ref.lock())
+                co_await self->DoSyncClock(*session);
+            else
+                co_return;
+
+            boost::system::error_code ec;
+            boost::asio::steady_timer t(co_await boost::asio::this_coro::executor, interval);
+            co_await t.async_wait(redirect_error(use_awaitable, ec));
+            if (ec) co_return;
+        }
+    });
+}
+
+awaitable<void> ByBitApi::DoSyncClock(HttpSession& session)
+{
+    // The warm connection is reused so the samples measure the request round trip only.
+    // A short burst lets the clock filter pick the sample least affected by queueing.
+    for (size_t i = 0; i < CLOCK_SYNC_BURST; ++i) {
+        if (!session.IsOpen()) {
+            co_await WaitHttpHost();
+            co_await session.Connect(m_http_endpoints, mConfig->ConnectStagger());
+        }
+        co_await DoRequestServer(session, REQ_TIME);
     }
 }
 
@@ -164,51 +240,208 @@ void ByBitApi::Resolve()
 
     std::clog << "Trying to resolve" << std::endl;
 
-    Spawn([self_ref](yield_context yield) {
-        if (auto self = self_ref.lock()) {
-            ip::tcp::resolver resolver(yield.get_executor()/*self->mScheduler->io()*/);
-            self->m_resolved_http_host = resolver.async_resolve(self->mConfig->HttpHost(), self->mConfig->HttpPort(), yield);
-        }
-    });
+    // Both resolve in parallel, the first results are published on the startup strand
+    SpawnResolve(mConfig->HttpHost(), mConfig->HttpPort(), m_http_endpoints, m_http_host_resolved, "http host resolved");
+    SpawnResolve(mConfig->StreamHost(), mConfig->StreamPort(), m_websock_endpoints, m_websock_host_resolved, "stream host resolved");
+}
 
-    Spawn([self_ref](yield_context yield) {
-        if (auto self = self_ref.lock()) {
-            ip::tcp::resolver resolver(yield.get_executor());
-            self->m_resolved_websock_host = resolver.async_resolve(self->mConfig->StreamHost(), self->mConfig->StreamPort(), yield);
+void ByBitApi::SpawnResolve(std::string host, std::string port, EndpointPool& endpoints, AsyncEvent& resolved, std::string step)
+{
+    // The endpoints and the event are members, they are only touched while the api is locked
+    Spawn(m_startup_strand, [ref = weak_from_this(), host, port, &endpoints, &resolved, step]() -> awaitable<void> {
+        ip::tcp::resolver resolver(co_await boost::asio::this_coro::executor);
+        for (;;) {
+            std::chrono::seconds refresh;
+            if (auto self = ref.lock()) {
+                refresh = self->mConfig->DnsRefreshInterval();
+                try {
+                    endpoints.Update(co_await resolver.async_resolve(host, port, use_awaitable));
+                }
+                catch (boost::system::system_error& e) {
+                    if (endpoints.Empty()) throw; // Nothing cached, retried by Spawn
+                    std::cerr << host << " resolve error, the cached addresses are kept: " << e.what() << std::endl;
+                }
+                if (!resolved.IsSet()) {
+                    resolved.Set();
+                    self->m_startup.Mark(step);
+                }
+            }
+            else co_return;
+
+            if (refresh.count() == 0) co_return;
+
+            boost::system::error_code ec;
+            boost::asio::steady_timer t(co_await boost::asio::this_coro::executor, refresh);
+            co_await t.async_wait(redirect_error(use_awaitable, ec));
+            if (ec) co_return;
         }
     });
 }
 
-void ByBitApi::DoPing(yield_context &yield)
+awaitable<void> ByBitApi::WaitHttpHost()
+{
+    co_await co_spawn(m_startup_strand, [this]() -> awaitable<void> {
+        co_await m_http_host_resolved.Wait();
+    }, use_awaitable);
+}
+
+awaitable<void> ByBitApi::WaitStreamHost()
+{
+    co_await co_spawn(m_startup_strand, [this]() -> awaitable<void> {
+        co_await m_websock_host_resolved.Wait();
+    }, use_awaitable);
+}
+
+awaitable<void> ByBitApi::DoPing()
 {
     std::clog << "Trying to connect: " << REQ_TIME << std::endl;
-    DoRequestServer(REQ_TIME, yield);
+    co_await DoRequestServer(REQ_TIME);
+}
+
+awaitable<std::shared_ptr<const InstrumentCatalogue>> ByBitApi::DoLoadCatalogue()
+{
+    co_await WaitHttpHost();
+
+    HttpSession session(mScheduler->io().get_executor(), mScheduler->ssl(), mConfig->HttpHost(), mConfig->SocketTuning());
+    auto catalogue = std::make_shared<InstrumentCatalogue>();
+
+    std::string cursor;
+    size_t page = 0;
+    do {
+        if (++page > CATALOGUE_MAX_PAGES) throw WrongServerData("InstrumentsInfo pagination does not end");
+
+        // The server may close the connection after a response
+        if (!session.IsOpen()) co_await session.Connect(m_http_endpoints, mConfig->ConnectStagger());
+
+        std::ostringstream buf;
+        buf << REQ_INSTRUMENT << "?category=spot&limit=" << CATALOGUE_PAGE_SIZE;
+        if (!cursor.empty()) buf << "&cursor=" << UrlEncode(cursor);
+        auto resp = co_await DoRequestServer(session, buf.str());
+
+        if (!resp["result"].is_object()) throw WrongServerData("InstrumentsInfo response contains no \"result\" section");
+        catalogue->Add(resp["result"]);
+
+        cursor = resp["result"].value("nextPageCursor", std::string());
+    } while (!cursor.empty());
+
+    std::clog << "Instrument catalogue: " << catalogue->Size() << " instruments in " << page << " pages" << std::endl;
+    co_return catalogue;
 }
 
-void ByBitApi::DoGetInstrumentInfo(const std::shared_ptr<ByBitSubscription> &subscription, yield_context &yield)
+awaitable<nlohmann::json> ByBitApi::DoFindInstrument(std::string symbol, std::chrono::steady_clock::time_point loaded_after)
 {
-    std::ostringstream buf;
-    buf << REQ_INSTRUMENT << "?category=spot&symbol=" << subscription->symbol;
-    auto resp = DoRequestServer(buf.str(), yield);
+    for (;;) {
+        if (m_catalogue_loading) {
+            co_await m_catalogue_ready.Wait();
+            continue; // The load may have failed or may have started too early
+        }
+
+        if (m_catalogue && m_catalogue_loaded_at && *m_catalogue_loaded_at >= loaded_after) {
+            if (auto result = m_catalogue->Result(symbol)) co_return *result;
+            throw UnknownInstrument("No " + symbol + " instrument in the spot catalogue");
+        }
 
-    if (resp["result"].is_object()) {
-        subscription->dataManager->HandleInstrumentData(resp["result"]);
+        m_catalogue_loading = true;
+        m_catalogue_ready.Reset();
+        auto started = std::chrono::steady_clock::now();
+        try {
+            auto catalogue = co_await DoLoadCatalogue();
+            m_catalogue = move(catalogue);
+            m_catalogue_loaded_at = started;
+        }
+        catch (...) {
+            m_catalogue_loading = false;
+            m_catalogue_ready.Set();
+            throw;
+        }
+        m_catalogue_loading = false;
+        m_catalogue_ready.Set();
     }
-    else throw WrongServerData("InstrumentsInfo response contains no \"result\" section");
+}
+
+awaitable<bool> ByBitApi::DoGetInstrumentInfo(std::shared_ptr<ByBitSubscription> subscription)
+{
+    auto result = co_await co_spawn(m_catalogue_strand,
+                                    DoFindInstrument(subscription->symbol, std::chrono::steady_clock::now() - CATALOGUE_MAX_AGE),
+                                    use_awaitable);
+
+    if (m_capture)
+        m_capture->Write(CapturedFrameKind::INSTRUMENT, {result.dump(), std::chrono::system_clock::now(), {}});
+    bool changed = subscription->dataManager->HandleInstrumentData(result);
+    m_startup.Mark(subscription->symbol + " instrument ready");
+    if (m_instrument_cache)
+        m_instrument_cache->Store(subscription->symbol, result);
+    co_return changed;
+}
+
+bool ByBitApi::ApplyCachedInstrumentInfo(const std::shared_ptr<ByBitSubscription>& subscription)
+{
+    // A resubscription after a stream error keeps the configuration it already has
+    if (subscription->IsReady()) return true;
+    if (!m_instrument_cache) return false;
+
+    auto cached = m_instrument_cache->Find(subscription->symbol);
+    if (!cached) return false;
+
+    try {
+        subscription->dataManager->HandleInstrumentData(*cached);
+    }
+    catch (std::exception& e) {
+        std::cerr << subscription->symbol << " cached instrument info is not usable: " << e.what() << std::endl;
+        return false;
+    }
+    if (!subscription->IsReady()) return false;
+
+    m_startup.Mark(subscription->symbol + " instrument ready");
+    return true;
+}
+
+void ByBitApi::SpawnInstrumentInfo(const std::shared_ptr<ByBitSubscription>& subscription)
+{
+    Spawn(subscription->strand, [subscription, ref=weak_from_this()]() -> awaitable<void> {
+        if (auto self = ref.lock()) {
+            bool changed;
+            try {
+                changed = co_await self->DoGetInstrumentInfo(subscription);
+            }
+            catch (UnknownInstrument& e) {
+                // Not retried: the catalogue is fresh and does not list the symbol
+                std::cerr << e.what() << ", unsubscribing" << std::endl;
+                self->Unsubscribe(subscription->symbol);
+                co_return;
+            }
+            if (changed)
+                self->ResubscribeOrderBook(subscription->symbol);
+            self->HandleSubscriptionBacklog(subscription);
+        }
+    });
+}
+
+void ByBitApi::ResubscribeOrderBook(const std::string& symbol)
+{
+    std::unique_lock lock(m_subscriptions_mutex);
+    if (!m_public_spot_stream) return;
+
+    // The exchange sends a new snapshot on subscription
+    std::array topics {SubscriptionTopic{"orderbook", 50, symbol}};
+    m_public_spot_stream->UnsubscribeTopics(topics);
+    m_public_spot_stream->SubscribeTopics(topics);
 }
 
 void ByBitApi::SpawnStream(std::shared_ptr<ByBitStream> stream, const std::string& symbol)
 {
     stream->Spawn();
-    stream->Message(stream->SubscribeMessage(
+    stream->SubscribeTopics(
         std::array {
             SubscriptionTopic{"publicTrade", symbol},
             SubscriptionTopic{"orderbook", 50, symbol},
-        }, true));
+        });
 }
 
 void ByBitApi::SubscribePublicStream(const std::shared_ptr<ByBitSubscription>& subscription)
 {
+    // Subscription strands of different symbols run in parallel, so the stream is created once under the lock
+    std::unique_lock lock(m_subscriptions_mutex);
     if (m_public_spot_stream) {
         if (m_public_spot_stream->Status() == ByBitStream::status::STALE)
             throw std::runtime_error("Stale public stream");
@@ -221,92 +454,121 @@ void ByBitApi::SubscribePublicStream(const std::shared_ptr<ByBitSubscription>& s
     }
     else {
         std::weak_ptr<ByBitApi> ref = weak_from_this();
-        m_public_spot_stream = std::make_shared<ByBitStream>(shared_from_this(), STREAM_PUBLIC_SPOT,
-            [ref](std::string&& data) { HandleConnectionData(ref, move(data)); },
+        m_public_spot_stream = std::make_shared<ByBitStream>(shared_from_this(), STREAM_PUBLIC_SPOT, m_public_stream_shard,
+            [ref, capture = m_capture](StreamFrame&& frame) {
+                if (capture) capture->Write(CapturedFrameKind::STREAM, frame);
+                HandleConnectionData(ref, move(frame));
+            },
             [ref](boost::system::error_code ec) { HandleConnectionError(ref, ec); });
 
         SpawnStream(m_public_spot_stream, subscription->symbol);
     }
 }
 
-void ByBitApi::HandleConnectionData(std::weak_ptr<ByBitApi> ref, std::string&& data)
+void ByBitApi::HandleConnectionData(std::weak_ptr<ByBitApi> ref, StreamFrame&& frame)
 {
-    if (auto self = ref.lock()) {
-        self->m_data_queue.push(move(data));
+    auto self = ref.lock();
+    if (!self) return;
+
+    // Only the topic is looked at on the read strand, JSON parsing is left to the symbol strand
+    std::string_view payload = frame.payload;
+    auto topic_pos = payload.find(R"("topic":")");
+    if (topic_pos == std::string_view::npos) {
+        auto data = nlohmann::json::parse(frame.payload);
+        if (data.contains("op")) {
+            if (data["success"])
+                std::clog << data["op"] << '/' << data["req_id"] << ": " << data["success"] << std::endl;
+            else
+                std::cerr << data["op"] << '/' << data["req_id"] << ": " << data["success"] << std::endl;
+        }
+        else
+            std::cerr << "Unhandled server data: " << frame.payload << std::endl;
+        return;
+    }
 
-        post(self->m_data_queue_strand, [ref]() {
-            if (auto self = ref.lock()) {
+    topic_pos += std::size(R"("topic":")") - 1;
+    auto topic_end = payload.find('"', topic_pos);
+    std::string_view topic = payload.substr(topic_pos, topic_end - topic_pos);
+    auto symbol_pos = topic.rfind('.');
+    if (topic_end == std::string_view::npos || symbol_pos == std::string_view::npos) {
+        std::cerr << "Unhandled server data: " << frame.payload << std::endl;
+        return;
+    }
 
-                /*self->m_data_queue.consume_all([ref](std::string data)*/
-                while (!self->m_data_queue.empty()) {
-                    auto payload = nlohmann::json::parse(self->m_data_queue.front());
-
-                    if (payload.find("op") != payload.end()) {
-                        self->m_data_queue.pop();
-                        if (payload["success"]) {
-                            std::clog << payload["op"] << '/' <<payload["req_id"] << ": " << payload["success"] << std::endl;
-                        }
-                        else {
-                            std::cerr << payload["op"] << '/' <<payload["req_id"] << ": " << payload["success"] << std::endl;
-                        }
-                    }
-                    else if (payload.find("topic") != payload.end()) {
-                        if (auto self = ref.lock()) {
-                            auto topic = SubscriptionTopic::Parse(payload["topic"]);
-                            if (topic.Symbol()) {
-                                auto subscript_it = self->m_subscriptions.find(std::string(*topic.Symbol()));
-                                if (subscript_it != self->m_subscriptions.end()) {
-                                    std::weak_ptr s = subscript_it->second;
-                                    if (auto subscription = s.lock()) {
-                                        if (subscription->IsReady()) {
-                                            subscription->Handle(topic, payload["type"].get<std::string>(), payload["data"]);
-                                            self->m_data_queue.pop();
-                                        }
-                                    }
-                                }
-                                else {
-                                    std::cerr << "Unhandled server data: " << self->m_data_queue.front() << std::endl;
-                                    self->m_data_queue.pop();
-                                }
-                            }
-                        }
-                    }
-                    else {
-                        std::cerr << "Unhandled server data: " << self->m_data_queue.front() << std::endl;
-                        self->m_data_queue.pop();
-                    }
-                }
-            }
-        });
+    std::shared_ptr<ByBitSubscription> subscription;
+    {
+        std::unique_lock lock(self->m_subscriptions_mutex);
+        if (auto it = self->m_subscriptions.find(std::string(topic.substr(symbol_pos + 1))); it != self->m_subscriptions.end())
+            subscription = it->second;
     }
+    if (!subscription) {
+        std::cerr << "Unhandled server data: " << frame.payload << std::endl;
+        return;
+    }
+
+    post(subscription->strand, [ref, subscription, frame = move(frame)]() mutable {
+        if (auto self = ref.lock())
+            self->HandleSubscriptionFrame(subscription, move(frame));
+    });
 }
 
-void ByBitApi::HandleConnectionError(std::weak_ptr<ByBitApi> ref, boost::system::error_code ec)
+void ByBitApi::HandleSubscriptionFrame(const std::shared_ptr<ByBitSubscription>& subscription, StreamFrame&& frame)
 {
-    if (auto self = ref.lock()) {
-        post(self->Scheduler()->io(), [ref, ec] {
-            if (auto self = ref.lock()) {
-                for (auto& s: self->m_subscriptions) {
-                    s.second->HandleError(ec);
-                }
-            }
-        });
+    if (!subscription->IsReady()) {
+        if (subscription->backlog.size() == ByBitSubscription::MAX_BACKLOG) {
+            // Any dropped frame may be the book snapshot the deltas apply to, so the book is started over
+            std::cerr << subscription->symbol << " backlog overflow, " << subscription->backlog.size() << " frames dropped, resyncing the order book" << std::endl;
+            subscription->backlog.clear();
+            if (subscription->dataManager) subscription->dataManager->ResetOrderBook();
+            ResubscribeOrderBook(subscription->symbol);
+        }
+        subscription->backlog.emplace_back(move(frame));
+        return;
     }
-}
 
+    try {
+        auto payload = nlohmann::json::parse(frame.payload);
+        auto topic = SubscriptionTopic::Parse(payload["topic"]);
+
+        auto received = frame.kernel_received.value_or(frame.received);
+        if (auto offset = m_clock_sync.Offset(received))
+            subscription->RecordLatency(topic.Title(), received + *offset, payload);
 
-void ByBitApi::CalcServerTime(time server_time, time request_time, time response_time)
+        subscription->Handle(topic, payload["type"].get<std::string>(), payload["data"], std::chrono::utc_clock::from_sys(received));
+
+        if (!subscription->bookReceived && topic.Title() == "orderbook") {
+            subscription->bookReceived = true;
+            m_startup.Mark(subscription->symbol + " first book");
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << subscription->symbol << " data error: " << e.what() << std::endl;
+    }
+}
+
+void ByBitApi::HandleSubscriptionBacklog(const std::shared_ptr<ByBitSubscription>& subscription)
 {
-    m_request_halftrip = std::chrono::duration_cast<milliseconds>(response_time - request_time) / 2;
-    m_server_time_delta = std::chrono::duration_cast<milliseconds>(server_time - request_time + m_request_halftrip);
+    if (!subscription->IsReady()) return;
 
-    std::clog << "now (ms):          " << std::chrono::duration_cast<milliseconds>(time::clock::now().time_since_epoch()).count() << std::endl;
-    std::clog << "request time (ms): " << std::chrono::duration_cast<milliseconds>(request_time.time_since_epoch()).count() << std::endl;
-    std::clog << "server time (ms):  " << std::chrono::duration_cast<milliseconds>(server_time.time_since_epoch()).count() << std::endl;
-    std::clog << "req halftrip (ms): " << m_request_halftrip.count() << std::endl;
-    std::clog << "server delta (ms): " << m_server_time_delta->count() << std::endl;
+    auto backlog = move(subscription->backlog);
+    subscription->backlog.clear();
+    for (auto& frame: backlog)
+        HandleSubscriptionFrame(subscription, move(frame));
+}
+
+void ByBitApi::HandleConnectionError(std::weak_ptr<ByBitApi> ref, boost::system::error_code ec)
+{
+    if (auto self = ref.lock()) {
+        std::unique_lock lock(self->m_subscriptions_mutex);
+        for (auto& s: self->m_subscriptions) {
+            post(s.second->strand, [subscription = s.second, ec] {
+                subscription->HandleError(ec);
+            });
+        }
+    }
 }
 
+
 // void ByBitApi::DoHttpRequest(std::shared_ptr<ByBitSubscription> subscriber, std::optional<uint32_t> tick_count, yield_context &yield)
 // {
     // if (!m_server_time_delta) {
@@ -428,11 +690,20 @@ std::shared_ptr<ByBitSubscription> ByBitApi::Subscribe(const std::string& symbol
         }
     }
 
-    Spawn([subscription, ref=weak_from_this()](yield_context yield) {
+    if (m_offline) return subscription;
+
+    // Runs on the subscription strand, so the instrument configuration is applied in order with the stream data
+    Spawn(subscription->strand, [subscription, ref=weak_from_this()]() -> awaitable<void> {
         if (auto self = ref.lock()) {
-            self->DoGetInstrumentInfo(subscription, yield);
+            if (self->ApplyCachedInstrumentInfo(subscription))
+                self->HandleSubscriptionBacklog(subscription);
+
+            // The stream is connected while the instrument is fetched, the frames wait in the backlog meanwhile.
+            // With the cached configuration the fetch only confirms it
             self->SubscribePublicStream(subscription);
+            self->SpawnInstrumentInfo(subscription);
         }
+        co_return;
     });
 
     return subscription;
@@ -440,12 +711,16 @@ std::shared_ptr<ByBitSubscription> ByBitApi::Subscribe(const std::string& symbol
 
 void ByBitApi::Unsubscribe(const std::string& symbol)
 {
+    std::shared_ptr<ByBitStream> released; // Closed after the lock is released, the close may block
     std::unique_lock lock(m_subscriptions_mutex);
 
     if (auto subscription_it = m_subscriptions.find(symbol); subscription_it != m_subscriptions.end()) {
         m_subscriptions.erase(subscription_it);
-        if (m_public_spot_stream->m_status == ByBitStream::status::STALE) {
-            m_public_spot_stream.reset();
+        if (!m_public_spot_stream) {
+            // Offline or not connected yet
+        }
+        else if (m_public_spot_stream->m_status == ByBitStream::status::STALE) {
+            released = move(m_public_spot_stream);
         }
         else {
             m_public_spot_stream->UnsubscribeTopics(std::array {
@@ -455,9 +730,123 @@ void ByBitApi::Unsubscribe(const std::string& symbol)
         }
     }
 
-    if (m_subscriptions.empty()) {
-        m_public_spot_stream.reset();
+    if (m_subscriptions.empty() && m_public_spot_stream) {
+        released = move(m_public_spot_stream);
+    }
+}
+
+void ByBitApi::Replay(CapturedFrameKind kind, StreamFrame&& frame)
+{
+    if (kind == CapturedFrameKind::STREAM) {
+        HandleConnectionData(weak_from_this(), move(frame));
+        return;
+    }
+    if (kind == CapturedFrameKind::GAP) {
+        uint64_t count = 0;
+        std::memcpy(&count, frame.payload.data(), std::min(sizeof(count), frame.payload.size()));
+        std::cerr << "Capture gap: " << count << " frames lost, order books wait for the next snapshot" << std::endl;
+
+        std::unique_lock lock(m_subscriptions_mutex);
+        for (const auto& [symbol, subscription]: m_subscriptions)
+            post(subscription->strand, [subscription]() { if (subscription->dataManager) subscription->dataManager->ResetOrderBook(); });
+        return;
+    }
+    if (kind != CapturedFrameKind::INSTRUMENT) throw std::invalid_argument("Unknown captured frame kind");
+
+    auto result = nlohmann::json::parse(frame.payload);
+    if (!result.contains("list") || !result["list"].is_array())
+        throw WrongServerData("Captured instrument info contains no \"list\" section");
+
+    for (const auto& instrument: result["list"]) {
+        std::shared_ptr<ByBitSubscription> subscription;
+        {
+            std::unique_lock lock(m_subscriptions_mutex);
+            if (auto it = m_subscriptions.find(instrument["symbol"].get<std::string>()); it != m_subscriptions.end())
+                subscription = it->second;
+        }
+        if (!subscription) continue;
+
+        // The same order as DoGetInstrumentInfo: the configuration is applied and then the backlog is drained
+        post(subscription->strand, [ref = weak_from_this(), subscription, result]() {
+            if (auto self = ref.lock()) {
+                try {
+                    subscription->dataManager->HandleInstrumentData(result);
+                    self->HandleSubscriptionBacklog(subscription);
+                }
+                catch (std::exception& e) {
+                    std::cerr << subscription->symbol << " instrument info error: " << e.what() << std::endl;
+                }
+            }
+        });
+    }
+}
+
+awaitable<void> ByBitApi::DrainSubscriptions()
+{
+    std::vector<std::shared_ptr<ByBitSubscription>> subscriptions;
+    {
+        std::unique_lock lock(m_subscriptions_mutex);
+        for (const auto& s: m_subscriptions) subscriptions.push_back(s.second);
+    }
+    // Strands run the handlers in order, so the posted one runs after all the frames posted before
+    for (const auto& subscription: subscriptions)
+        co_await post(subscription->strand, use_awaitable);
+}
+
+std::optional<uint64_t> ByBitApi::CapturedFrames() const
+{
+    if (!m_capture) return {};
+    return m_capture->Frames();
+}
+
+std::optional<uint64_t> ByBitApi::CaptureDropped() const
+{
+    if (!m_capture) return {};
+    return m_capture->Dropped();
+}
+
+std::optional<LatencyHistogram::Snapshot> ByBitApi::PublicStreamRoundTrip()
+{
+    std::unique_lock lock(m_subscriptions_mutex);
+    if (m_public_spot_stream)
+        return m_public_spot_stream->RoundTrip();
+    return {};
+}
+
+std::optional<LatencyHistogram::Snapshot> ByBitApi::PublicStreamDecodeLatency()
+{
+    std::unique_lock lock(m_subscriptions_mutex);
+    if (m_public_spot_stream)
+        return m_public_spot_stream->DecodeLatency();
+    return {};
+}
+
+std::optional<double> ByBitApi::PublicStreamReadsPerFrame()
+{
+    std::unique_lock lock(m_subscriptions_mutex);
+    if (m_public_spot_stream)
+        return m_public_spot_stream->ReadsPerFrame();
+    return {};
+}
+
+std::optional<LatencyHistogram::Snapshot> ByBitApi::FeedLatency(const std::string& symbol, std::string_view topic)
+{
+    std::unique_lock lock(m_subscriptions_mutex);
+    if (auto subscription_it = m_subscriptions.find(symbol); subscription_it != m_subscriptions.end()) {
+        if (auto it = subscription_it->second->feedLatency.find(topic); it != subscription_it->second->feedLatency.end())
+            return it->second.system.Snap();
+    }
+    return {};
+}
+
+std::optional<LatencyHistogram::Snapshot> ByBitApi::MatchingLatency(const std::string& symbol, std::string_view topic)
+{
+    std::unique_lock lock(m_subscriptions_mutex);
+    if (auto subscription_it = m_subscriptions.find(symbol); subscription_it != m_subscriptions.end()) {
+        if (auto it = subscription_it->second->feedLatency.find(topic); it != subscription_it->second->feedLatency.end())
+            return it->second.engine.Snap();
     }
+    return {};
 }
 
 
@@ -12,12 +12,17 @@
 #include <shared_mutex>
 
 #include <boost/container/flat_map.hpp>
-#include <boost/lockfree/spsc_queue.hpp>
 #include <nlohmann/json.hpp>
 
 #include "scheduler.hpp"
+#include "async_event.hpp"
 #include "data_provider.hpp"
 #include "currency.hpp"
+#include "latency_histogram.hpp"
+#include "startup_timeline.hpp"
+#include "clock_sync.hpp"
+#include "socket_options.hpp"
+#include "endpoint_pool.hpp"
 
 class Config;
 
@@ -33,6 +38,25 @@ public:
 
     virtual const std::string& StreamHost() const = 0;
     virtual const std::string& StreamPort() const = 0;
+    virtual std::chrono::milliseconds StreamPingInterval() const = 0;
+
+    virtual std::chrono::seconds ClockSyncInterval() const = 0;
+
+    // Hosts are resolved again in the background with this interval, 0 resolves once
+    virtual std::chrono::seconds DnsRefreshInterval() const = 0;
+    // Delay before a connect to the next resolved address is started in parallel
+    virtual std::chrono::milliseconds ConnectStagger() const = 0;
+
+    // Directory to keep the instrument info cache in, empty disables the cache
+    virtual const std::string& DataDir() const = 0;
+
+    virtual const SocketOptions& SocketTuning() const = 0;
+
+    // Order book levels per side mirrored to shared memory, 0 disables the mirror
+    virtual size_t SharedBookDepth() const = 0;
+
+    // File to log the raw public stream frames to, empty disables the capture
+    virtual const std::string& CaptureFile() const = 0;
 };
 
 class SchedulerError : public std::runtime_error
@@ -66,6 +90,13 @@ public:
     WrongServerData(std::string&& what) noexcept : std::runtime_error(move(what)) {}
 };
 
+// The exchange does not list the symbol, retrying will not help
+class UnknownInstrument : public WrongServerData
+{
+public:
+    UnknownInstrument(std::string&& what) noexcept : WrongServerData(move(what)) {}
+};
+
 using std::chrono::seconds;
 using std::chrono::milliseconds;
 
@@ -76,10 +107,23 @@ typedef std::deque<kline_type> kline_sequence_type;
 typedef kline_sequence_type::iterator kline_iterator;
 typedef kline_type::const_iterator const_kline_iterator;
 
+struct StreamFrame
+{
+    std::string payload;
+    std::chrono::system_clock::time_point received; // Local time the websocket read of the frame has completed
+    std::optional<std::chrono::system_clock::time_point> kernel_received; // SO_TIMESTAMPING time the frame data has reached the host
+};
+
 struct ByBitSubscription;
 struct ByBitDataManager;
 
+enum class CapturedFrameKind: uint8_t;
+class FrameCapture;
+class InstrumentCache;
+class InstrumentCatalogue;
+
 class ByBitStream;
+class HttpSession;
 
 class ByBitApi: public std::enable_shared_from_this<ByBitApi>
 {
@@ -91,48 +135,136 @@ private:
 
     std::shared_ptr<AsioScheduler> mScheduler;
 
-    boost::asio::ip::tcp::resolver::results_type m_resolved_http_host;
-    boost::asio::ip::tcp::resolver::results_type m_resolved_websock_host;
+    StartupTimeline m_startup;
+
+    // Resolved addresses with connect stats, refreshed in the background
+    EndpointPool m_http_endpoints;
+    EndpointPool m_websock_endpoints;
 
-    milliseconds m_request_halftrip = milliseconds(0);
-    std::optional<milliseconds> m_server_time_delta;
+    // The first resolution events, accessed on m_startup_strand.
+    // The steps needing a host wait for its event, so each one starts as soon as its input is there
+    boost::asio::strand<boost::asio::any_io_executor> m_startup_strand;
+    AsyncEvent m_http_host_resolved;
+    AsyncEvent m_websock_host_resolved;
+
+    ClockSync m_clock_sync;
 
     boost::container::flat_map<std::string, std::shared_ptr<ByBitSubscription>> m_subscriptions;
     std::mutex m_subscriptions_mutex;
 
-    std::shared_ptr<ByBitStream> m_public_spot_stream;
-    boost::lockfree::spsc_queue<std::string> m_data_queue;
-    boost::asio::strand<boost::asio::any_io_executor> m_data_queue_strand;
+    const size_t m_public_stream_shard;
+    std::shared_ptr<ByBitStream> m_public_spot_stream; // Guarded by m_subscriptions_mutex
+
+    std::shared_ptr<FrameCapture> m_capture;
+    std::shared_ptr<InstrumentCache> m_instrument_cache;
+
+    // Spot instrument list shared by all the subscriptions, the members below are accessed on m_catalogue_strand
+    boost::asio::strand<boost::asio::any_io_executor> m_catalogue_strand;
+    std::shared_ptr<const InstrumentCatalogue> m_catalogue;
+    std::optional<std::chrono::steady_clock::time_point> m_catalogue_loaded_at;
+    bool m_catalogue_loading = false;
+    AsyncEvent m_catalogue_ready;
+    bool m_offline = false;
 
     void Resolve();
+    void SpawnResolve(std::string host, std::string port, EndpointPool& endpoints, AsyncEvent& resolved, std::string step);
+    // Wait for the first host resolution, may be called from any executor
+    awaitable<void> WaitHttpHost();
+    awaitable<void> WaitStreamHost();
 
-    void Spawn(std::function<void(yield_context yield)>);
+    // Runs the task as a coroutine, the task is restarted after a pause if it throws
+    void Spawn(std::function<awaitable<void>()>);
+    void Spawn(boost::asio::any_io_executor executor, std::function<awaitable<void>()>);
 
-    nlohmann::json DoRequestServer(std::string_view request_string, yield_context &yield);
+    awaitable<nlohmann::json> DoRequestServer(std::string request_string);
+    awaitable<nlohmann::json> DoRequestServer(HttpSession& session, std::string request_string);
+
+    void SpawnClockSync();
+    awaitable<void> DoSyncClock(HttpSession& session);
 
     void SpawnStream(std::shared_ptr<ByBitStream> stream, const std::string &symbol);
 
     //void DoHttpRequest(std::shared_ptr<ByBitSubscription> subscriber, std::optional<uint32_t> tick_count, yield_context &yield);
 
-    void DoPing(yield_context &yield);
+    awaitable<void> DoPing();
+
+    // Loads all the pages of the spot instrument list over one connection
+    awaitable<std::shared_ptr<const InstrumentCatalogue>> DoLoadCatalogue();
+    // Runs on m_catalogue_strand. Reuses a catalogue loaded not earlier than loaded_after or the load in progress,
+    // so the subscriptions made at once share one load
+    awaitable<nlohmann::json> DoFindInstrument(std::string symbol, std::chrono::steady_clock::time_point loaded_after);
 
-    void DoGetInstrumentInfo(const std::shared_ptr<ByBitSubscription> &subscription, yield_context &yield);
+    // Returns true if the instrument precision has changed, so the order book needs a resync
+    awaitable<bool> DoGetInstrumentInfo(std::shared_ptr<ByBitSubscription> subscription);
+    // Configures the data manager from the cache, true if it is ready for the stream data.
+    // Called on the subscription strand
+    bool ApplyCachedInstrumentInfo(const std::shared_ptr<ByBitSubscription>& subscription);
+    // Fetches the instrument info and releases the backlog, retried until it succeeds
+    void SpawnInstrumentInfo(const std::shared_ptr<ByBitSubscription>& subscription);
+    void ResubscribeOrderBook(const std::string& symbol);
 
     void SubscribePublicStream(const std::shared_ptr<ByBitSubscription>& subscription);
 
-    static void HandleConnectionData(std::weak_ptr<ByBitApi> ref, std::string&& data);
-    static void HandleConnectionError(std::weak_ptr<ByBitApi> ref, boost::system::error_code ec);
+    // Both are called on the subscription strand
+    void HandleSubscriptionFrame(const std::shared_ptr<ByBitSubscription>& subscription, StreamFrame&& frame);
+    void HandleSubscriptionBacklog(const std::shared_ptr<ByBitSubscription>& subscription);
 
-    void CalcServerTime(time server_time, time request_time, time response_time);
+    static void HandleConnectionData(std::weak_ptr<ByBitApi> ref, StreamFrame&& frame);
+    static void HandleConnectionError(std::weak_ptr<ByBitApi> ref, boost::system::error_code ec);
 public:
     explicit ByBitApi(std::shared_ptr<Config> config, std::shared_ptr<AsioScheduler> scheduler);
     static std::shared_ptr<ByBitApi> Create(std::shared_ptr<Config> config, std::shared_ptr<AsioScheduler> scheduler);
+    // Makes no network requests, subscriptions are fed with Replay() only
+    static std::shared_ptr<ByBitApi> CreateOffline(std::shared_ptr<Config> config, std::shared_ptr<AsioScheduler> scheduler);
 
     const std::shared_ptr<AsioScheduler>& Scheduler() const
     { return mScheduler; }
 
+    const std::shared_ptr<Config>& Configuration() const
+    { return mConfig; }
+
     std::shared_ptr<ByBitSubscription> Subscribe(const std::string& symbol, std::shared_ptr<ByBitDataManager> manager);
     void Unsubscribe(const std::string& symbol);
+
+    // Handles a captured frame the same way as one received from the exchange
+    void Replay(CapturedFrameKind kind, StreamFrame&& frame);
+
+    // Completes when the frames handed to the subscriptions so far are handled
+    awaitable<void> DrainSubscriptions();
+
+    // Frames written to the capture file so far
+    std::optional<uint64_t> CapturedFrames() const;
+    // Frames dropped because the capture writer has fallen behind
+    std::optional<uint64_t> CaptureDropped() const;
+
+    // Ping/pong round trip of the current public stream connection
+    std::optional<LatencyHistogram::Snapshot> PublicStreamRoundTrip();
+    // Kernel receive to decoded frame time of the current public stream connection, needs rx timestamps on
+    std::optional<LatencyHistogram::Snapshot> PublicStreamDecodeLatency();
+    // Socket reads per websocket frame of the current public stream connection
+    std::optional<double> PublicStreamReadsPerFrame();
+
+    // Resolved addresses and their connect statistics
+    const EndpointPool& HttpEndpoints() const
+    { return m_http_endpoints; }
+    const EndpointPool& StreamEndpoints() const
+    { return m_websock_endpoints; }
+
+    const ClockSync& ServerClock() const
+    { return m_clock_sync; }
+
+    // Host resolution, stream connection, instrument configuration and the first order book of each symbol
+    const StartupTimeline& Startup() const
+    { return m_startup; }
+
+    std::optional<std::chrono::nanoseconds> ServerTimeOffset() const
+    { return m_clock_sync.Offset(std::chrono::system_clock::now()); }
+
+    // One-way latency from the exchange frame timestamp ("ts") to the local receive time, corrected by the server time offset.
+    // The kernel receive time is used when available so the local processing is not included
+    std::optional<LatencyHistogram::Snapshot> FeedLatency(const std::string& symbol, std::string_view topic);
+    // The same measured from the matching engine timestamp ("cts"), orderbook topic only
+    std::optional<LatencyHistogram::Snapshot> MatchingLatency(const std::string& symbol, std::string_view topic);
 };
 
 
@@ -0,0 +1,155 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "bybit/capture.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace scratcher::bybit {
+
+namespace {
+
+int64_t UnixTimeNs(std::chrono::system_clock::time_point t)
+{ return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count(); }
+
+std::chrono::system_clock::time_point FromUnixTimeNs(int64_t ns)
+{ return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns))); }
+
+}
+
+FrameCapture::FrameCapture(const std::filesystem::path& path)
+    : m_file(path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_file) throw std::runtime_error("Failed to create capture file " + path.string());
+
+    CaptureFileHeader header {};
+    std::memcpy(header.magic, CaptureFileHeader::MAGIC, sizeof(header.magic));
+    header.version = CaptureFileHeader::VERSION;
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    m_writer = std::thread([this] { Run(); });
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::unique_lock lock(m_mutex);
+        AppendGap(); // Frames dropped at the very end
+        m_stop = true;
+    }
+    m_signal.notify_one();
+    m_writer.join();
+}
+
+void FrameCapture::AppendRecord(const CaptureRecordHeader& header, const char* payload)
+{
+    const char* bytes = reinterpret_cast<const char*>(&header);
+    m_pending.insert(m_pending.end(), bytes, bytes + sizeof(header));
+    m_pending.insert(m_pending.end(), payload, payload + header.size);
+}
+
+void FrameCapture::AppendGap()
+{
+    if (!m_gap_frames) return;
+
+    CaptureRecordHeader header {m_gap_received_ns, 0, sizeof(m_gap_frames), CapturedFrameKind::GAP, {}};
+    AppendRecord(header, reinterpret_cast<const char*>(&m_gap_frames));
+    m_gap_frames = 0;
+}
+
+void FrameCapture::Write(CapturedFrameKind kind, const StreamFrame& frame)
+{
+    CaptureRecordHeader header {UnixTimeNs(frame.received), frame.kernel_received ? UnixTimeNs(*frame.kernel_received) : 0,
+                                static_cast<uint32_t>(frame.payload.size()), kind, {}};
+    {
+        std::unique_lock lock(m_mutex);
+        // Room for the GAP record is reserved too, so it is never lost
+        size_t gap_size = m_gap_frames ? sizeof(CaptureRecordHeader) + sizeof(m_gap_frames) : 0;
+        if (m_pending.size() + gap_size + sizeof(header) + frame.payload.size() > MAX_PENDING) {
+            if (!m_gap_frames++) m_gap_received_ns = header.received_ns;
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        AppendGap();
+        AppendRecord(header, frame.payload.data());
+    }
+    m_frames.fetch_add(1, std::memory_order_relaxed);
+    m_signal.notify_one();
+}
+
+void FrameCapture::Run()
+{
+    std::vector<char> buffer;
+    std::unique_lock lock(m_mutex);
+    for (;;) {
+        m_signal.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+        if (m_pending.empty() && m_stop) break;
+
+        buffer.swap(m_pending);
+        lock.unlock();
+
+        if (!m_file.write(buffer.data(), buffer.size()).flush())
+            std::cerr << "Capture write failed, " << buffer.size() << " bytes lost" << std::endl;
+        buffer.clear();
+
+        lock.lock();
+    }
+}
+
+FrameReplay::FrameReplay(const std::filesystem::path& path)
+    : m_file(path, std::ios::binary)
+{
+    CaptureFileHeader header {};
+    if (!m_file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, CaptureFileHeader::MAGIC, sizeof(header.magic)) != 0 || header.version != CaptureFileHeader::VERSION)
+        throw std::runtime_error("Wrong capture file " + path.string());
+}
+
+bool FrameReplay::Next(CapturedFrameKind& kind, StreamFrame& frame)
+{
+    CaptureRecordHeader header;
+    if (!m_file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (header.size > FrameCapture::MAX_PENDING) throw std::runtime_error("Wrong capture record size");
+
+    frame.payload.resize(header.size);
+    if (!m_file.read(frame.payload.data(), header.size)) return false; // The last frame may be cut by a crash
+
+    kind = header.kind;
+    frame.received = FromUnixTimeNs(header.received_ns);
+    frame.kernel_received = header.kernel_received_ns ? std::make_optional(FromUnixTimeNs(header.kernel_received_ns)) : std::nullopt;
+    return true;
+}
+
+boost::asio::awaitable<void> FrameReplay::Run(std::shared_ptr<ByBitApi> api, Pace pace)
+{
+    boost::asio::steady_timer timer(co_await boost::asio::this_coro::executor);
+
+    auto start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::system_clock::time_point> first_received;
+
+    CapturedFrameKind kind;
+    StreamFrame frame;
+    while (Next(kind, frame)) {
+        if (pace == Pace::ORIGINAL) {
+            if (!first_received) first_received = frame.received;
+            timer.expires_at(start + (frame.received - *first_received));
+            co_await timer.async_wait(boost::asio::use_awaitable);
+        }
+
+        api->Replay(kind, std::move(frame));
+        frame = {};
+        ++m_frames;
+    }
+    co_await api->DrainSubscriptions();
+    m_elapsed = std::chrono::steady_clock::now() - start;
+}
+
+}
@@ -0,0 +1,123 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef BYBIT_CAPTURE_HPP
+#define BYBIT_CAPTURE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/awaitable.hpp>
+
+#include "bybit.hpp"
+
+namespace scratcher::bybit {
+
+enum class CapturedFrameKind: uint8_t {
+    STREAM = 1,     // Public stream websocket payload
+    INSTRUMENT,     // "result" of the instruments-info response, replayed instead of the HTTP request
+    GAP             // Frames dropped by the capture, the payload is their uint64 count. Books are not valid until the next snapshot
+};
+
+// Capture file: the header followed by records, each is the record header and the payload bytes
+struct CaptureFileHeader
+{
+    static constexpr char MAGIC[8] = "SCRCAPT";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+static_assert(sizeof(CaptureFileHeader) == 16);
+
+struct CaptureRecordHeader
+{
+    int64_t received_ns;        // Unix time the frame was read
+    int64_t kernel_received_ns; // SO_TIMESTAMPING Unix time, 0 if not taken
+    uint32_t size;
+    CapturedFrameKind kind;
+    uint8_t reserved[3];
+};
+static_assert(sizeof(CaptureRecordHeader) == 24);
+
+// Logs raw frames as they were received. The caller only copies the frame into a memory buffer under a short lock,
+// the file is written by a separate thread. Frames are dropped if the writer falls behind by MAX_PENDING bytes,
+// a GAP record is written in their place before the next frame that fits.
+class FrameCapture
+{
+public:
+    static constexpr size_t MAX_PENDING = 64 << 20;
+
+private:
+    std::ofstream m_file;
+
+    std::mutex m_mutex;
+    std::condition_variable m_signal;
+    std::vector<char> m_pending;
+    bool m_stop = false;
+    uint64_t m_gap_frames = 0;      // Dropped since the last GAP record
+    int64_t m_gap_received_ns = 0;  // Receive time of the first of them
+
+    std::atomic<uint64_t> m_frames = 0;
+    std::atomic<uint64_t> m_dropped = 0;
+
+    std::thread m_writer;
+
+    void Run();
+    void AppendRecord(const CaptureRecordHeader& header, const char* payload); // Under m_mutex
+    void AppendGap(); // Under m_mutex
+
+public:
+    explicit FrameCapture(const std::filesystem::path& path);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    void Write(CapturedFrameKind kind, const StreamFrame& frame);
+
+    uint64_t Frames() const
+    { return m_frames.load(std::memory_order_relaxed); }
+    uint64_t Dropped() const
+    { return m_dropped.load(std::memory_order_relaxed); }
+};
+
+// Pushes captured frames through ByBitApi as if they came from the exchange.
+// The api is expected to be created offline, so it makes no requests of its own.
+// Frames keep the captured receive times, so the data handling gets the same input on every run.
+class FrameReplay
+{
+public:
+    enum class Pace { ORIGINAL, FAST };
+
+private:
+    std::ifstream m_file;
+    uint64_t m_frames = 0;
+    std::chrono::steady_clock::duration m_elapsed {};
+
+    bool Next(CapturedFrameKind& kind, StreamFrame& frame);
+
+public:
+    explicit FrameReplay(const std::filesystem::path& path);
+
+    // ORIGINAL waits the captured time between frames, FAST pushes them back to back
+    boost::asio::awaitable<void> Run(std::shared_ptr<ByBitApi> api, Pace pace);
+
+    uint64_t Frames() const
+    { return m_frames; }
+    std::chrono::steady_clock::duration Elapsed() const
+    { return m_elapsed; }
+};
+
+}
+
+#endif //BYBIT_CAPTURE_HPP
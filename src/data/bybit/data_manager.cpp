@@ -4,6 +4,7 @@
 // file LICENSE or https://opensource.org/license/mit
 //
 
+#include <algorithm>
 #include <iostream>
 
 #include "bybit/data_manager.hpp"
@@ -14,9 +15,11 @@
 namespace scratcher::bybit {
 
 ByBitDataManager::ByBitDataManager(std::string symbol, std::shared_ptr<ByBitApi> api)
-    : DataProvider()
+    : DataProvider(make_strand(api->Scheduler()->io(api->Scheduler()->ShardFor(symbol))))
     , m_symbol(move(symbol)), mApi(move(api))
 {
+    if (size_t depth = mApi->Configuration()->SharedBookDepth())
+        m_shared_book = std::make_unique<SharedBookPublisher>(m_symbol, depth);
 }
 
 std::shared_ptr<ByBitDataManager> ByBitDataManager::Create(std::string symbol, std::shared_ptr<ByBitApi> api)
@@ -26,8 +29,10 @@ std::shared_ptr<ByBitDataManager> ByBitDataManager::Create(std::string symbol, s
     return collector;
 }
 
-void ByBitDataManager::HandleInstrumentData(const nlohmann::json &data)
+bool ByBitDataManager::HandleInstrumentData(const nlohmann::json &data)
 {
+    bool changed = false;
+
     if (data["category"] != "spot") throw WrongServerData("Wrong InstrumentsInfo category: " + data["category"].get<std::string>());
     if (!data["list"].is_array())  throw WrongServerData("No or wrong InstrumentsInfo list");
 
@@ -45,19 +50,46 @@ void ByBitDataManager::HandleInstrumentData(const nlohmann::json &data)
               instr["lotSizeFilter"].contains("maxOrderAmt") ))
             throw WrongServerData("No or wrong InstrumentsInfo lotSizeFilter");
 
-        m_price_point = currency<uint64_t>(instr["priceFilter"]["tickSize"].get<std::string>());
+        currency<uint64_t> price_point(instr["priceFilter"]["tickSize"].get<std::string>());
+        currency<uint64_t> volume_point(instr["lotSizeFilter"]["basePrecision"].get<std::string>());
+
+        // Points keep their meaning while the decimals are the same, a tick size change alone needs no resync
+        changed = (m_price_point && m_price_point->decimals() != price_point.decimals()) ||
+                  (m_volume_point && m_volume_point->decimals() != volume_point.decimals());
+
+        // emplace, since assignment of a currency with other decimals throws
+        m_price_point.emplace(price_point);
+
+        m_price_precision.emplace(instr["lotSizeFilter"]["quotePrecision"].get<std::string>());
+        m_volume_point.emplace(volume_point);
+        m_volume_precision.emplace(instr["lotSizeFilter"]["basePrecision"].get<std::string>());
+        m_min_volume.emplace(instr["lotSizeFilter"]["minOrderQty"].get<std::string>());
+        m_max_volume.emplace(instr["lotSizeFilter"]["maxOrderQty"].get<std::string>());
+        m_min_amount.emplace(instr["lotSizeFilter"]["minOrderAmt"].get<std::string>());
+        m_max_amount.emplace(instr["lotSizeFilter"]["maxOrderAmt"].get<std::string>());
+    }
+
+    if (changed) {
+        std::clog << m_symbol << " instrument precision has changed, resyncing the order book" << std::endl;
+        ResetOrderBook();
+        m_public_trade_cache.clear();
+        ResetData();
+        m_book_update_id = 0;
 
-        m_price_precision = currency<uint64_t>(instr["lotSizeFilter"]["quotePrecision"].get<std::string>());
-        m_volume_point = currency<uint64_t>(instr["lotSizeFilter"]["basePrecision"].get<std::string>());
-        m_volume_precision = currency<uint64_t>(instr["lotSizeFilter"]["basePrecision"].get<std::string>());
-        m_min_volume = currency<uint64_t>(instr["lotSizeFilter"]["minOrderQty"].get<std::string>());
-        m_max_volume = currency<uint64_t>(instr["lotSizeFilter"]["maxOrderQty"].get<std::string>());
-        m_min_amount = currency<uint64_t>(instr["lotSizeFilter"]["minOrderAmt"].get<std::string>());
-        m_max_amount = currency<uint64_t>(instr["lotSizeFilter"]["maxOrderAmt"].get<std::string>());
+        // Readers of the shared book see the new decimals with no levels until the next snapshot
+        if (m_shared_book) PublishSharedBook();
     }
+    return changed;
 }
 
-void ByBitDataManager::HandleData(const SubscriptionTopic& topic, const std::string& type, const nlohmann::json& data)
+void ByBitDataManager::ResetOrderBook()
+{
+    m_order_book_bids.clear();
+    m_order_book_asks.clear();
+    m_book_resync = true;
+}
+
+void ByBitDataManager::HandleData(const SubscriptionTopic& topic, const std::string& type, const nlohmann::json& data, time received)
 {
     if (*topic.Symbol() != m_symbol) throw std::invalid_argument("Instrument symbol does not match: " + std::string(*topic.Symbol()));
     if (!IsReadyHandleData()) throw std::runtime_error("Instrument configuration is not ready");
@@ -88,7 +120,9 @@ void ByBitDataManager::HandleData(const SubscriptionTopic& topic, const std::str
 
             std::clog << side_str << ": " << trade_time << ", price (points): " << price.raw() << ", volume (points): " << value.raw() << std::endl;
 
-            m_public_trade_cache.emplace_back(move(id), trade_time, price.raw(), value.raw(), side);
+            if (m_public_trade_cache.size() == TRADE_CACHE_SIZE)
+                m_public_trade_cache.pop_front();
+            Publish(m_public_trade_cache.emplace_back(move(id), trade_time, price.raw(), value.raw(), side));
         }
     }
     else if (topic.Title() == "orderbook"){
@@ -97,65 +131,122 @@ void ByBitDataManager::HandleData(const SubscriptionTopic& topic, const std::str
 
         std::clog << data.dump() << std::endl;
 
-        if (type == "snapshot") {
-            m_order_book_bids.clear();
-            m_order_book_asks.clear();
-
-            for (const auto& bid: data["b"]) {
-                if (!(bid.is_array() && bid.size() == 2)) throw std::invalid_argument("Wrong order book bid entry");
+        if (type != "snapshot" && type != "delta") throw std::invalid_argument("Unknown order book data type: " + type);
 
-                currency<uint64_t> price = *m_price_point;
-                price.parse(bid[0].get<std::string>());
+        if (m_book_resync) {
+            if (type != "snapshot") return;
+            m_book_resync = false;
+        }
 
-                currency<uint64_t> volume = *m_volume_point;
-                volume.parse(bid[1].get<std::string>());
+        OrderBookUpdate update {type == "snapshot", data.contains("u") ? data["u"].get<uint64_t>() : 0, received, {}, {}};
 
-                m_order_book_bids.emplace_hint(m_order_book_bids.begin(), price.raw(), volume.raw());
-            }
-            for (const auto& ask: data["a"]) {
-                if (!(ask.is_array() && ask.size() == 2)) throw std::invalid_argument("Wrong order book bid entry");
+        auto parse_levels = [this](const nlohmann::json& levels, std::vector<BookLevel>& res) {
+            res.reserve(levels.size());
+            for (const auto& level: levels) {
+                if (!(level.is_array() && level.size() == 2)) throw std::invalid_argument("Wrong order book entry");
 
                 currency<uint64_t> price = *m_price_point;
-                price.parse(ask[0].get<std::string>());
+                price.parse(level[0].get<std::string>());
 
                 currency<uint64_t> volume = *m_volume_point;
-                volume.parse(ask[1].get<std::string>());
+                volume.parse(level[1].get<std::string>());
 
-                m_order_book_bids.emplace_hint(m_order_book_bids.end(), price.raw(), volume.raw());
+                res.push_back({price.raw(), volume.raw()});
             }
-        }
-        else if (type == "delta") {
-            for (const auto& bid: data["b"]) {
-                if (!(bid.is_array() && bid.size() == 2)) throw std::invalid_argument("Wrong order book bid entry");
+        };
+        parse_levels(data["b"], update.bids);
+        parse_levels(data["a"], update.asks);
+
+        auto apply_levels = [&update](const std::vector<BookLevel>& levels, auto& book) {
+            if (update.snapshot) book.clear();
+            for (const auto& level: levels) {
+                if (level.volume_points == 0)
+                    book.erase(level.price_points);
+                else
+                    book[level.price_points] = level.volume_points;
+            }
+        };
+        apply_levels(update.bids, m_order_book_bids);
+        apply_levels(update.asks, m_order_book_asks);
+        m_book_update_id = update.update_id;
+        m_book_received = update.received;
 
-                currency<uint64_t> price = *m_price_point;
-                price.parse(bid[0].get<std::string>());
+        UpdateTopOfBook(
+            m_order_book_bids.empty() ? BookLevel{} : BookLevel{m_order_book_bids.rbegin()->first, m_order_book_bids.rbegin()->second},
+            m_order_book_asks.empty() ? BookLevel{} : BookLevel{m_order_book_asks.begin()->first, m_order_book_asks.begin()->second},
+            m_book_update_id);
 
-                currency<uint64_t> volume = *m_volume_point;
-                volume.parse(bid[1].get<std::string>());
+        if (m_shared_book) PublishSharedBook();
 
-                if (volume.raw() == 0)
-                    m_order_book_bids.erase(price.raw());
-                else
-                    m_order_book_bids[price.raw()] = volume.raw();
-            }
-            for (const auto& ask: data["a"]) {
-                if (!(ask.is_array() && ask.size() == 2)) throw std::invalid_argument("Wrong order book bid entry");
+        Publish(update);
+    }
+}
 
-                currency<uint64_t> price(0, 2);
-                price.parse(ask[0].get<std::string>());
+void ByBitDataManager::Snapshot(EventQueue<Trade>& queue)
+{
+    for (const auto& trade: m_public_trade_cache)
+        queue.Push(trade);
+}
 
-                currency<uint64_t> volume(0, 8);
-                volume.parse(ask[1].get<std::string>());
+void ByBitDataManager::Snapshot(EventQueue<OrderBookUpdate>& queue)
+{
+    OrderBookUpdate book {true, m_book_update_id, m_book_received, {}, {}};
+    book.bids.reserve(m_order_book_bids.size());
+    for (const auto& [price, volume]: m_order_book_bids)
+        book.bids.push_back({price, volume});
+    book.asks.reserve(m_order_book_asks.size());
+    for (const auto& [price, volume]: m_order_book_asks)
+        book.asks.push_back({price, volume});
+    queue.Push(book);
+}
 
-                if (volume.raw() == 0)
-                    m_order_book_asks.erase(price.raw());
-                else
-                    m_order_book_asks[price.raw()] = volume.raw();
-            }
+void ByBitDataManager::PublishSharedBook()
+{
+    SharedBookImage& image = m_shared_image;
+    image.update_id = m_book_update_id;
+    image.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    image.price_decimals = static_cast<uint32_t>(m_price_point->decimals());
+    image.volume_decimals = static_cast<uint32_t>(m_volume_point->decimals());
+
+    // Levels below the count are cleared down to the published depth, so the previous update leaves nothing behind
+    size_t depth = m_shared_book->Depth();
+    auto fill = [depth](auto begin, auto end, BookLevel* levels, uint32_t& count) {
+        count = 0;
+        for (auto it = begin; it != end && count < depth; ++it)
+            levels[count++] = {it->first, it->second};
+        std::fill(levels + count, levels + depth, BookLevel{});
+    };
+    fill(m_order_book_bids.rbegin(), m_order_book_bids.rend(), image.bids, image.bid_count);
+    fill(m_order_book_asks.begin(), m_order_book_asks.end(), image.asks, image.ask_count);
+
+    m_shared_book->Publish(image);
+}
+
+void ByBitDataManager::CandleClosed(const Candle& candle)
+{
+    const auto& candles = Candles();
+    size_t count = std::min(candles.size(), VWAP_CANDLES);
+    std::vector<Candle> window(candles.end() - count, candles.end());
+
+    SubmitAnalytics(VWAP_1H, [window = move(window)] {
+        double weighted = 0, volume = 0;
+        for (const auto& c: window) {
+            weighted += (double(c.high_points) + c.low_points + c.close_points) / 3 * c.volume_points;
+            volume += c.volume_points;
         }
-        else throw std::invalid_argument("Unknown order book data type: " + type);
-    }
+        return volume > 0 ? weighted / volume : 0.0;
+    });
+}
+
+void ByBitDataManager::SubmitAnalytics(uint32_t indicator, std::function<double()> job)
+{
+    mApi->Scheduler()->compute().Submit([ref = std::weak_ptr(self()), indicator, job = move(job)] {
+        double value = job();
+        if (auto self = ref.lock()) {
+            if (!self->m_analytics_results.bounded_push({indicator, std::chrono::utc_clock::now(), value}))
+                self->m_analytics_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
 }
 
 void ByBitDataManager::HandleError(boost::system::error_code ec)
@@ -163,7 +254,7 @@ void ByBitDataManager::HandleError(boost::system::error_code ec)
     std::cerr << "websock error: " << ec.message() << std::endl;
 
     mApi->Unsubscribe(m_symbol);
-    mApi->Subscribe(m_symbol, shared_from_this());
+    mApi->Subscribe(m_symbol, self());
 }
 } // scratcher::bybit
 
@@ -14,10 +14,12 @@
 
 #include <boost/system/system_error.hpp>
 #include <boost/container/flat_map.hpp>
+#include <boost/lockfree/queue.hpp>
 
 #include <nlohmann/json.hpp>
 
 #include "data_provider.hpp"
+#include "shared_book.hpp"
 
 
 namespace scratcher::bybit {
@@ -26,8 +28,18 @@ class ByBitApi;
 class SubscriptionTopic;
 
 
-class ByBitDataManager: public DataProvider, public std::enable_shared_from_this<ByBitDataManager>
+class ByBitDataManager: public DataProvider
 {
+public:
+    // AnalyticsResult::indicator values
+    enum Indicator: uint32_t {
+        VWAP_1H = 1     // Volume weighted typical price of the last 60 closed candles, price points
+    };
+
+private:
+    static constexpr size_t TRADE_CACHE_SIZE = 1024;
+    static constexpr size_t VWAP_CANDLES = 60;
+
     const std::string m_symbol;
     std::shared_ptr<ByBitApi> mApi;
 
@@ -44,18 +56,54 @@ class ByBitDataManager: public DataProvider, public std::enable_shared_from_this
 
     boost::container::flat_map<uint64_t, uint64_t> m_order_book_bids;
     boost::container::flat_map<uint64_t, uint64_t> m_order_book_asks;
+    uint64_t m_book_update_id = 0;
+    time m_book_received {};
+    bool m_book_resync = false; // Deltas are skipped until the next snapshot
+
+    std::unique_ptr<SharedBookPublisher> m_shared_book;
+    SharedBookImage m_shared_image {}; // Reused, so the levels are not zeroed in full on every update
+
+    static constexpr size_t ANALYTICS_QUEUE_SIZE = 1024;
+    boost::lockfree::queue<AnalyticsResult, boost::lockfree::capacity<ANALYTICS_QUEUE_SIZE>> m_analytics_results;
+    std::atomic<uint64_t> m_analytics_dropped = 0;
+
+    void PublishSharedBook();
+
+    std::shared_ptr<ByBitDataManager> self()
+    { return std::static_pointer_cast<ByBitDataManager>(shared_from_this()); }
+
+protected:
+    using DataProvider::Snapshot;
+    void Snapshot(EventQueue<Trade>& queue) override;
+    void Snapshot(EventQueue<OrderBookUpdate>& queue) override;
+    void CandleClosed(const Candle& candle) override;
+
 public:
     ByBitDataManager(std::string symbol, std::shared_ptr<ByBitApi> api);
 
     static std::shared_ptr<ByBitDataManager> Create(std::string symbol, std::shared_ptr<ByBitApi> api);
 
-    void HandleInstrumentData(const nlohmann::json& data);
+    // Returns true if the price or volume precision of an already configured instrument has changed.
+    // The book and the trade cache are dropped then, the order book stream must be resubscribed for a new snapshot.
+    bool HandleInstrumentData(const nlohmann::json& data);
     bool IsReadyHandleData() const
     { return m_price_point && m_volume_point; }
 
-    void HandleData(const SubscriptionTopic& topic, const std::string& type, const nlohmann::json& data);
+    // The receive time is the kernel timestamp of the frame if taken, otherwise the time it was read
+    void HandleData(const SubscriptionTopic& topic, const std::string& type, const nlohmann::json& data, time received);
+    // Drops the book and skips deltas until the next snapshot, the caller is to resubscribe the order book stream
+    void ResetOrderBook();
     void HandleError(boost::system::error_code ec);
 
+    // Runs the job on the compute pool, so it never delays socket reads.
+    // The job must capture copies of the data it needs, the result is passed back through a lock-free queue.
+    void SubmitAnalytics(uint32_t indicator, std::function<double()> job);
+    bool PopAnalyticsResult(AnalyticsResult& result)
+    { return m_analytics_results.pop(result); }
+    // Results lost because the queue was not drained in time
+    uint64_t AnalyticsDropped() const
+    { return m_analytics_dropped.load(std::memory_order_relaxed); }
+
     //void AddUpdateConsumer(std::shared_ptr<IUpdateConsumer>) override;
 
 };
@@ -0,0 +1,105 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "bybit/http_session.hpp"
+
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace scratcher::bybit {
+
+namespace {
+
+const std::chrono::seconds CONNECT_TIMEOUT = std::chrono::seconds(30);
+const std::chrono::seconds REQUEST_TIMEOUT = std::chrono::seconds(10);
+
+}
+
+HttpSession::HttpSession(boost::asio::any_io_executor executor, boost::asio::ssl::context& ssl, std::string host, const SocketOptions& socket_options)
+    : m_executor(std::move(executor)), m_ssl(ssl), m_host(std::move(host)), m_socket_options(socket_options)
+{
+}
+
+boost::asio::awaitable<void> HttpSession::Connect(EndpointPool& endpoints, std::chrono::milliseconds stagger)
+{
+    Close();
+
+    boost::system::error_code error;
+    auto stream = std::make_unique<stream_type>(m_executor, m_ssl);
+
+    // The winning socket of the race is handed over to the stream, which keeps its own executor
+    auto socket = co_await RaceConnect(endpoints, m_socket_options, stagger, CONNECT_TIMEOUT);
+    auto protocol = socket.remote_endpoint().protocol();
+    get_lowest_layer(*stream).socket().assign(protocol, socket.release());
+
+    get_lowest_layer(*stream).expires_after(CONNECT_TIMEOUT);
+
+    ApplySocketOptions(get_lowest_layer(*stream).socket(), m_socket_options);
+
+    if (!SSL_set_tlsext_host_name(stream->native_handle(), m_host.c_str()))
+        throw std::ios_base::failure( "Failed to set SNI Hostname");
+
+    co_await stream->async_handshake(boost::asio::ssl::stream_base::client, boost::asio::redirect_error(boost::asio::use_awaitable, error));
+    if (error) throw error;
+
+    get_lowest_layer(*stream).expires_never();
+
+    m_stream = std::move(stream);
+}
+
+boost::asio::awaitable<HttpSession::Response> HttpSession::Request(std::string target)
+{
+    if (!IsOpen()) throw boost::system::error_code(boost::asio::error::not_connected);
+
+    boost::system::error_code error;
+
+    boost::beast::http::request<boost::beast::http::string_body> req(boost::beast::http::verb::get, boost::beast::string_view(target.data(), target.size()), 11);
+    req.set(boost::beast::http::field::host, m_host);
+    req.keep_alive(true);
+    req.prepare_payload();
+
+    Response resp;
+
+    get_lowest_layer(*m_stream).expires_after(REQUEST_TIMEOUT);
+
+    co_await boost::beast::http::async_write(*m_stream, req, boost::asio::redirect_error(boost::asio::use_awaitable, error));
+    if (error) {
+        Close();
+        throw error;
+    }
+    resp.sent = std::chrono::system_clock::now();
+
+    // The kernel drops QUICKACK after a while, so it is re-armed for each response
+    if (m_socket_options.tcp_quickack)
+        RearmQuickAck(get_lowest_layer(*m_stream).socket());
+
+    co_await boost::beast::http::async_read(*m_stream, m_buffer, resp.message, boost::asio::redirect_error(boost::asio::use_awaitable, error));
+    resp.received = std::chrono::system_clock::now();
+    if (error) {
+        Close();
+        throw error;
+    }
+
+    get_lowest_layer(*m_stream).expires_never();
+
+    if (!resp.message.keep_alive())
+        Close();
+
+    co_return resp;
+}
+
+void HttpSession::Close()
+{
+    if (m_stream) {
+        boost::system::error_code ignore;
+        get_lowest_layer(*m_stream).socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignore);
+        get_lowest_layer(*m_stream).close();
+        m_stream.reset();
+    }
+    m_buffer.clear();
+}
+
+}
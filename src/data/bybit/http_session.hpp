@@ -0,0 +1,61 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef BYBIT_HTTP_SESSION_HPP
+#define BYBIT_HTTP_SESSION_HPP
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/ssl.hpp>
+
+#include "socket_options.hpp"
+#include "endpoint_pool.hpp"
+
+namespace scratcher::bybit {
+
+// HTTPS connection which is kept alive between requests.
+// Request timestamps are taken around the request itself, connect and TLS handshake are not included.
+// Not thread safe: requests must be made one at a time from a single coroutine.
+class HttpSession
+{
+    using stream_type = boost::beast::ssl_stream<boost::beast::tcp_stream>;
+
+    boost::asio::any_io_executor m_executor;
+    boost::asio::ssl::context& m_ssl;
+    const std::string m_host;
+    const SocketOptions m_socket_options;
+
+    std::unique_ptr<stream_type> m_stream;
+    boost::beast::flat_buffer m_buffer;
+
+public:
+    struct Response
+    {
+        boost::beast::http::response<boost::beast::http::string_body> message;
+        std::chrono::system_clock::time_point sent;     // Request has been written
+        std::chrono::system_clock::time_point received; // Response has been read
+    };
+
+    HttpSession(boost::asio::any_io_executor executor, boost::asio::ssl::context& ssl, std::string host, const SocketOptions& socket_options);
+
+    bool IsOpen() const
+    { return m_stream && boost::beast::get_lowest_layer(*m_stream).socket().is_open(); }
+
+    // Races the connects to the pool addresses, see RaceConnect()
+    boost::asio::awaitable<void> Connect(EndpointPool& endpoints, std::chrono::milliseconds stagger);
+    boost::asio::awaitable<Response> Request(std::string target);
+    void Close();
+};
+
+}
+
+#endif //BYBIT_HTTP_SESSION_HPP
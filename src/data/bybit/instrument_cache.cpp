@@ -0,0 +1,130 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "bybit/instrument_cache.hpp"
+
+#include <fstream>
+#include <iostream>
+
+namespace scratcher::bybit {
+
+InstrumentCache::InstrumentCache(std::filesystem::path path, std::shared_ptr<AsioScheduler> scheduler)
+    : m_path(std::move(path))
+    , m_scheduler(std::move(scheduler))
+    , m_instruments(nlohmann::json::object())
+    , m_pending(nlohmann::json::object())
+    , m_flush_timer(m_scheduler->io())
+{
+    std::ifstream file(m_path);
+    if (!file) return;
+
+    auto instruments = nlohmann::json::parse(file, nullptr, false);
+    if (instruments.is_object())
+        m_instruments = std::move(instruments);
+    else
+        std::cerr << "Ignoring broken instrument cache " << m_path << std::endl;
+}
+
+InstrumentCache::~InstrumentCache()
+{
+    if (m_pending.empty()) return;
+
+    auto instruments = m_instruments;
+    for (const auto& [symbol, result]: m_pending.items())
+        instruments[symbol] = result;
+    try {
+        Write(instruments);
+    }
+    catch (std::exception& e) {
+        std::cerr << "Instrument cache write failed: " << e.what() << std::endl;
+    }
+}
+
+std::optional<nlohmann::json> InstrumentCache::Find(const std::string& symbol)
+{
+    std::unique_lock lock(m_mutex);
+    if (auto it = m_pending.find(symbol); it != m_pending.end())
+        return *it;
+    if (auto it = m_instruments.find(symbol); it != m_instruments.end())
+        return *it;
+    return {};
+}
+
+void InstrumentCache::Store(const std::string& symbol, const nlohmann::json& result)
+{
+    std::unique_lock lock(m_mutex);
+    if (auto it = m_pending.find(symbol); it != m_pending.end()) {
+        if (*it == result) return;
+    }
+    else if (auto it = m_instruments.find(symbol); it != m_instruments.end() && *it == result) return;
+
+    m_pending[symbol] = result;
+    ScheduleFlush(FLUSH_DELAY);
+}
+
+void InstrumentCache::ScheduleFlush(std::chrono::steady_clock::duration delay)
+{
+    // Called under the lock
+    if (m_flush_scheduled) return;
+    m_flush_scheduled = true;
+
+    m_flush_timer.expires_after(delay);
+    m_flush_timer.async_wait([ref = weak_from_this()](boost::system::error_code ec) {
+        if (ec) return;
+        if (auto self = ref.lock())
+            self->m_scheduler->compute().Submit([ref] { if (auto self = ref.lock()) self->Flush(); });
+    });
+}
+
+void InstrumentCache::Flush()
+{
+    nlohmann::json instruments, written;
+    {
+        std::unique_lock lock(m_mutex);
+        instruments = m_instruments;
+        written = m_pending;
+    }
+    for (const auto& [symbol, result]: written.items())
+        instruments[symbol] = result;
+
+    try {
+        Write(instruments);
+    }
+    catch (std::exception& e) {
+        std::cerr << "Instrument cache write failed, retrying later: " << e.what() << std::endl;
+        std::unique_lock lock(m_mutex);
+        m_flush_scheduled = false;
+        ScheduleFlush(RETRY_DELAY);
+        return;
+    }
+
+    // The memory follows the file only once it is in place, an entry changed meanwhile stays pending
+    std::unique_lock lock(m_mutex);
+    m_instruments = std::move(instruments);
+    for (const auto& [symbol, result]: written.items()) {
+        if (auto it = m_pending.find(symbol); it != m_pending.end() && *it == result)
+            m_pending.erase(it);
+    }
+    m_flush_scheduled = false;
+    if (!m_pending.empty())
+        ScheduleFlush(FLUSH_DELAY);
+}
+
+void InstrumentCache::Write(const nlohmann::json& instruments) const
+{
+    // Written aside and renamed, so a crash never leaves a half written file
+    std::filesystem::create_directories(m_path.parent_path());
+    auto temp_path = m_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        file << instruments.dump(2);
+        if (!file.flush()) throw std::runtime_error("Failed to write instrument cache " + temp_path.string());
+    }
+    std::filesystem::rename(temp_path, m_path);
+}
+
+}
@@ -0,0 +1,62 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef BYBIT_INSTRUMENT_CACHE_HPP
+#define BYBIT_INSTRUMENT_CACHE_HPP
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <boost/asio/steady_timer.hpp>
+#include <nlohmann/json.hpp>
+
+#include "scheduler.hpp"
+
+namespace scratcher::bybit {
+
+// Instrument info responses kept on disk, so a restart can configure the data managers before the REST round trip.
+// The file is a JSON object of the instruments-info "result" sections by symbol.
+// Changes are collected for a while and written at once by a compute pool job, so a startup with many symbols
+// rewrites the file a few times instead of once per symbol and no file I/O runs on the I/O threads.
+class InstrumentCache: public std::enable_shared_from_this<InstrumentCache>
+{
+public:
+    static constexpr std::chrono::seconds FLUSH_DELAY {1};
+    static constexpr std::chrono::minutes RETRY_DELAY {1};
+
+private:
+    const std::filesystem::path m_path;
+    const std::shared_ptr<AsioScheduler> m_scheduler;
+
+    std::mutex m_mutex;
+    nlohmann::json m_instruments;   // As written to the file
+    nlohmann::json m_pending;       // Changed since the last write
+    boost::asio::steady_timer m_flush_timer;
+    bool m_flush_scheduled = false; // Also set while a flush runs, so flushes never overlap
+
+    void ScheduleFlush(std::chrono::steady_clock::duration delay);
+    void Flush();
+    void Write(const nlohmann::json& instruments) const;
+
+public:
+    // A missing or broken file gives an empty cache
+    InstrumentCache(std::filesystem::path path, std::shared_ptr<AsioScheduler> scheduler);
+    // Writes out the pending changes
+    ~InstrumentCache();
+
+    std::optional<nlohmann::json> Find(const std::string& symbol);
+
+    // Schedules the file rewrite if the info has changed. A failed write is logged and retried later
+    void Store(const std::string& symbol, const nlohmann::json& result);
+};
+
+}
+
+#endif //BYBIT_INSTRUMENT_CACHE_HPP
@@ -0,0 +1,40 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "bybit/instrument_catalogue.hpp"
+
+#include "bybit.hpp"
+
+namespace scratcher::bybit {
+
+void InstrumentCatalogue::Add(const nlohmann::json& result)
+{
+    if (!result.contains("category") || !result["category"].is_string()) throw WrongServerData("No or wrong InstrumentsInfo category");
+    if (!result.contains("list") || !result["list"].is_array()) throw WrongServerData("No or wrong InstrumentsInfo list");
+
+    auto category = result["category"].get<std::string>();
+    if (m_category.empty())
+        m_category = category;
+    else if (category != m_category)
+        throw WrongServerData("InstrumentsInfo category mismatch: " + category);
+
+    const auto& list = result["list"];
+    m_instruments.reserve(m_instruments.size() + list.size());
+    for (const auto& instrument: list) {
+        if (!instrument.contains("symbol") || !instrument["symbol"].is_string()) throw WrongServerData("No or wrong InstrumentsInfo symbol");
+        m_instruments.insert_or_assign(instrument["symbol"].get<std::string>(), instrument);
+    }
+}
+
+std::optional<nlohmann::json> InstrumentCatalogue::Result(const std::string& symbol) const
+{
+    auto it = m_instruments.find(symbol);
+    if (it == m_instruments.end()) return {};
+
+    return nlohmann::json {{"category", m_category}, {"list", nlohmann::json::array({it->second})}};
+}
+
+}
@@ -0,0 +1,37 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef BYBIT_INSTRUMENT_CATALOGUE_HPP
+#define BYBIT_INSTRUMENT_CATALOGUE_HPP
+
+#include <optional>
+#include <string>
+
+#include <boost/container/flat_map.hpp>
+#include <nlohmann/json.hpp>
+
+namespace scratcher::bybit {
+
+// Instrument list of a category, assembled from the pages of instruments-info responses and indexed by symbol
+class InstrumentCatalogue
+{
+    std::string m_category;
+    boost::container::flat_map<std::string, nlohmann::json> m_instruments;
+
+public:
+    // Adds the instruments of one response "result" page
+    void Add(const nlohmann::json& result);
+
+    // Result section of the kind a single symbol request returns, so ByBitDataManager can apply it as is
+    std::optional<nlohmann::json> Result(const std::string& symbol) const;
+
+    size_t Size() const
+    { return m_instruments.size(); }
+};
+
+}
+
+#endif //BYBIT_INSTRUMENT_CATALOGUE_HPP
@@ -5,13 +5,21 @@
 //
 
 #include "bybit/stream.hpp"
+#include <algorithm>
 #include <iostream>
 
 #include "bybit.hpp"
 
 namespace scratcher::bybit {
 
-const char* const MESSAGE_PING = R"({"op": "ping"})";
+namespace {
+
+const size_t MAX_PENDING_PINGS = 16;
+
+// ByBit public spot stream accepts up to 10 args per subscribe/unsubscribe request
+const size_t MAX_TOPICS_PER_MESSAGE = 10;
+
+}
 
 SubscriptionTopic SubscriptionTopic::Parse(std::string topic)
 {
@@ -38,10 +46,12 @@ SubscriptionTopic SubscriptionTopic::Parse(std::string topic)
 }
 
 
-ByBitStream::ByBitStream(std::shared_ptr<ByBitApi> api, std::string spec, std::function<void(std::string&&)> callback, std::function<void(boost::system::error_code)> error_callback)
-    : m_api(api), m_path_spec(move(spec)), m_status(status::INIT)
-    , m_strand(make_strand(api->Scheduler()->io()))
-    , m_heartbeat_timer(m_strand, seconds(15))
+ByBitStream::ByBitStream(std::shared_ptr<ByBitApi> api, std::string spec, size_t shard, std::function<void(StreamFrame&&)> callback, std::function<void(boost::system::error_code)> error_callback)
+    : m_api(api), m_path_spec(move(spec)), m_shard(shard), m_status(status::INIT)
+    , m_strand(make_strand(api->Scheduler()->io(shard)))
+    , m_ready(m_strand)
+    , m_writer_timer(m_strand)
+    , m_ping_interval(api->mConfig->StreamPingInterval())
     , m_data_callback(move(callback)), m_error_callback(move(error_callback))
 {
 }
@@ -54,74 +64,94 @@ ByBitStream::~ByBitStream()
 
 void ByBitStream::Spawn()
 {
-    spawn(m_strand, [ref = weak_from_this()](yield_context yield) {
-        if (auto self = ref.lock()) {
-            for (;;) {
-                boost::system::error_code ec;
-                self->DoOpenWebSocketStream(yield[ec]);
-                if (ec) {
-                    std::cerr << ec.message() << std::endl;
-                    ec.clear();
-
-                    boost::asio::steady_timer t(self->m_strand, milliseconds(500));
-                    t.async_wait(yield[ec]);
-
-                    if (!ec) continue;
-
-                    // Timer error case
-                    std::cerr << "Repeat timer error: " << ec.message() << std::endl;
-                    return;
-                }
+    co_spawn(m_strand, [ref = weak_from_this()]() -> awaitable<void> {
+        auto self = ref.lock();
+        if (!self) co_return;
+
+        for (;;) {
+            try {
+                co_await self->DoOpenWebSocketStream();
                 break;
             }
-            self->DoReadWebSocketStream(yield);
+            catch (boost::system::error_code& e) {
+                std::cerr << e.message() << std::endl;
+            }
+
+            boost::system::error_code ec;
+            boost::asio::steady_timer t(self->m_strand, milliseconds(500));
+            co_await t.async_wait(redirect_error(use_awaitable, ec));
+
+            if (ec) {
+                // Timer error case
+                std::cerr << "Repeat timer error: " << ec.message() << std::endl;
+                self->m_status = status::STALE;
+                self->m_ready.Set();
+                co_return;
+            }
         }
-    });
-    Heartbeat();
+
+        self->m_status = status::READY;
+        self->m_ready.Set();
+        if (auto api = self->m_api.lock())
+            api->m_startup.Mark("stream " + self->m_path_spec + " connected");
+
+        co_await self->DoReadWebSocketStream();
+    },
+    [](std::exception_ptr ex) { if (ex) std::rethrow_exception(ex); });
+
+    co_spawn(m_strand, [ref = weak_from_this()]() -> awaitable<void> {
+        if (auto self = ref.lock())
+            co_await self->DoWriteWebSocketStream();
+    },
+    [](std::exception_ptr ex) { if (ex) std::rethrow_exception(ex); });
 }
 
-void ByBitStream::DoOpenWebSocketStream(yield_context yield)
+awaitable<void> ByBitStream::DoOpenWebSocketStream()
 {
     auto api = m_api.lock();
-    if (!api) return;
+    if (!api) co_return;
 
-    // if (!api->m_server_time_delta) {
-    //     *yield.ec_ = xscratcher_error_code(error::no_time_sync);
-    //     return;
-    // }
+    // if (!api->m_server_time_delta)
+    //     throw xscratcher_error_code(error::no_time_sync);
 
-    if (api->m_resolved_websock_host.empty()) {
-        *yield.ec_ = xscratcher_error_code(error::no_host_name);
-        return;
-    }
+    // Waits for the resolution instead of failing, so the connection starts as soon as the host is known
+    co_await api->WaitStreamHost();
 
     if (m_websock) {
-        if (m_websock->is_open()) {
-            *yield.ec_ = xscratcher_error_code(error::already_opened);
-            return;
-        }
+        if (m_websock->is_open())
+            throw xscratcher_error_code(error::already_opened);
         m_websock.reset();
     }
 
     auto websock = std::make_unique<websocket>(m_strand, api->Scheduler()->ssl());
 
-    get_lowest_layer(*websock).expires_after(seconds(30));
-
-    auto connect_result = get_lowest_layer(*websock).async_connect(api->m_resolved_websock_host, yield);
-    if (*yield.ec_) {
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::endpoint connect_result;
+    try {
+        // The winning socket of the race is handed over to the stream, which keeps its strand
+        auto socket = co_await RaceConnect(api->m_websock_endpoints, api->mConfig->SocketTuning(), api->mConfig->ConnectStagger(), seconds(30));
+        connect_result = socket.remote_endpoint();
+        get_lowest_layer(*websock).socket().assign(connect_result.protocol(), socket.release());
+    }
+    catch (boost::system::error_code&) {
         std::cerr << "stream connect error: ";
-        return;
+        throw;
     }
 
+    websock->next_layer().next_layer().Configure(api->mConfig->SocketTuning());
+#ifdef BOOST_ASIO_HAS_IO_URING
+    websock->next_layer().next_layer().UseRegisteredBuffers(api->Scheduler()->read_buffers(m_shard));
+#endif
+
     if (!SSL_set_tlsext_host_name(websock->next_layer().native_handle(), api->mConfig->StreamHost().c_str()))
         throw std::ios_base::failure("Failed to set SNI Hostname");
 
     get_lowest_layer(*websock).expires_after(seconds(30));
 
-    websock->next_layer().async_handshake(ssl::stream_base::client, yield);
-    if (*yield.ec_) {
+    co_await websock->next_layer().async_handshake(ssl::stream_base::client, redirect_error(use_awaitable, ec));
+    if (ec) {
         std::cerr << "ssl handshake error: ";
-        return;
+        throw ec;
     }
 
     // Turn off the timeout on the tcp_stream, because
@@ -141,18 +171,19 @@ void ByBitStream::DoOpenWebSocketStream(yield_context yield)
 
     std::clog << "WebSock handshake: " << host_port << "  " << m_path_spec << std::endl;
 
-    websock->async_handshake(host_port, m_path_spec, yield);
-    if (*yield.ec_) {
-        std::cerr << "web-sock handshake error: " << yield.ec_->message() << std::endl;
-        return;
+    co_await websock->async_handshake(host_port, m_path_spec, redirect_error(use_awaitable, ec));
+    if (ec) {
+        std::cerr << "web-sock handshake error: " << ec.message() << std::endl;
+        throw ec;
     }
 
     m_websock = move(websock);
-    m_last_heartbeat = std::chrono::system_clock::now();
-    m_status = status::READY;
+    m_frames = 0;
+    m_socket_reads = 0;
+    m_last_heartbeat = std::chrono::steady_clock::now();
 }
 
-void ByBitStream::DoReadWebSocketStream(yield_context yield)
+awaitable<void> ByBitStream::DoReadWebSocketStream()
 {
     boost::beast::flat_buffer buffer;
 
@@ -161,24 +192,34 @@ void ByBitStream::DoReadWebSocketStream(yield_context yield)
             break;
 
         boost::system::error_code ec;
-        m_websock->async_read(buffer, yield[ec]);
+        co_await m_websock->async_read(buffer, redirect_error(use_awaitable, ec));
+        auto received = std::chrono::system_clock::now();
 
         if (ec) {
             std::clog << "error" << std::endl;
             m_status = status::STALE;
+            m_writer_timer.cancel();
             m_error_callback(ec);
             break;
         }
 
         if (buffer.size() != 0) {
+            m_frames.fetch_add(1, std::memory_order_relaxed);
+            m_socket_reads.store(m_websock->next_layer().next_layer().SocketReads(), std::memory_order_relaxed);
+
+            auto kernel_received = m_websock->next_layer().next_layer().TakeReceiveTime();
+            if (kernel_received)
+                m_decode_latency.Record(received - *kernel_received);
+
             std::string data = boost::beast::buffers_to_string(buffer.data());
-            m_data_callback(move(data));
             buffer.clear();
+            if (!HandlePong(data))
+                m_data_callback({move(data), received, kernel_received});
         }
         else {
                 // std::clog << "web-sock wait..." << std::endl;
-                // boost::asio::steady_timer local_timer(yield.get_executor(), milliseconds(50));
-                // local_timer.async_wait(yield);
+                // boost::asio::steady_timer local_timer(m_strand, milliseconds(50));
+                // co_await local_timer.async_wait(use_awaitable);
         }
     }
 
@@ -188,65 +229,117 @@ void ByBitStream::DoReadWebSocketStream(yield_context yield)
     }
 }
 
-void ByBitStream::Heartbeat()
+awaitable<void> ByBitStream::DoWriteWebSocketStream()
 {
-    spawn(m_strand, [ref = weak_from_this()](yield_context yield) {
-        if (std::shared_ptr self = ref.lock()) {
+    // The only coroutine writing to the websocket, so writes never overlap
+    co_await m_ready.Wait();
+
+    while (m_status == status::READY) {
+        std::string message;
+        if (!m_outbound.empty()) {
+            message = SubscribeMessage(m_outbound.front());
+            m_outbound.pop_front();
+        }
+        else if (std::chrono::steady_clock::now() - m_last_heartbeat >= m_ping_interval) {
+            uint32_t req_id = ++m_req_counter;
+            message = PingMessage(req_id);
+
+            if (m_pending_pings.size() >= MAX_PENDING_PINGS)
+                m_pending_pings.erase(m_pending_pings.begin());
+
+            m_last_heartbeat = std::chrono::steady_clock::now();
+            m_pending_pings.emplace(req_id, m_last_heartbeat);
+        }
+        else {
             boost::system::error_code ec;
-            while (self->m_status == status::INIT) {
-                boost::asio::steady_timer local_timer(self->m_strand, milliseconds(50));
-                local_timer.async_wait(yield);
-            }
-            while (self->m_status != status::STALE) {
-                if (std::chrono::duration_cast<seconds>(std::chrono::system_clock::now() - self->m_last_heartbeat.load()) > seconds(20)) {
-                    std::ostringstream buf;
-                    buf << R"({"req_id":")" << ++(self->m_req_counter) << R"(","op":"ping"})" ;
-                    std::string message = buf.str();
-
-                    std::clog << "web-sock ping: " << message << " ... " << std::flush;
-                    self->m_websock->async_write(boost::asio::buffer(message), yield[ec]);
-                    if (ec) {
-                        self->m_status = status::STALE;
-
-                        std::clog << "error" << std::endl;
-                        self->m_error_callback(ec);
-                        return;
-                    }
-                    std::clog << "ok" << std::endl;
-                    self->m_last_heartbeat = std::chrono::system_clock::now();
-                }
-                else {
-                    self->m_heartbeat_timer.async_wait(yield);
-                }
-            }
+            m_writer_timer.expires_at(m_last_heartbeat + m_ping_interval);
+            co_await m_writer_timer.async_wait(redirect_error(use_awaitable, ec));
+            // Cancelled by Enqueue() or expired for the ping, both are handled by the next round
+            continue;
         }
-    });
+
+        boost::system::error_code ec;
+        std::clog << "web-sock write: " << message << " ... " << std::flush;
+        co_await m_websock->async_write(boost::asio::buffer(message), redirect_error(use_awaitable, ec));
+        if (ec) {
+            m_status = status::STALE;
+
+            std::clog << "error" << std::endl;
+            m_error_callback(ec);
+            co_return;
+        }
+        std::clog << "ok" << std::endl;
+    }
 }
 
-void ByBitStream::Message(std::string message)
+void ByBitStream::Enqueue(bool subscribe, std::vector<std::string> topics)
 {
-    spawn(m_strand, [message, ref = weak_from_this()](yield_context yield) {
+    dispatch(m_strand, [subscribe, topics = move(topics), ref = weak_from_this()]() mutable {
         if (auto self = ref.lock()) {
-            boost::system::error_code ec;
-
-            while (self->m_status == status::INIT) {
-                boost::asio::steady_timer local_timer(self->m_strand, milliseconds(50));
-                local_timer.async_wait(yield);
-            }
+            if (self->m_status == status::STALE) return;
 
-            std::clog << "web-sock write: " << message << " ... " << std::flush;
-            self->m_websock->async_write(boost::asio::buffer(message), yield[ec]);
-            if (ec) {
-                self->m_status = status::STALE;
+            for (auto& topic: topics) {
+                auto& queue = self->m_outbound;
+                if (queue.empty() || queue.back().subscribe != subscribe || queue.back().topics.size() >= MAX_TOPICS_PER_MESSAGE)
+                    queue.push_back({subscribe, {}});
 
-                std::clog << "error" << std::endl;
-                self->m_error_callback(ec);
-                return;
+                auto& op_topics = queue.back().topics;
+                if (std::find(op_topics.begin(), op_topics.end(), topic) == op_topics.end())
+                    op_topics.emplace_back(move(topic));
             }
-            std::clog << "ok" << std::endl;
-            self->m_last_heartbeat = std::chrono::system_clock::now();
+            self->m_writer_timer.cancel();
         }
     });
 }
 
+bool ByBitStream::HandlePong(const std::string& data)
+{
+    // Cheap pre-check to keep JSON parsing off the market data path
+    if (data.size() > 256 || (data.find(R"("op":"ping")") == std::string::npos && data.find(R"("op":"pong")") == std::string::npos))
+        return false;
+
+    auto payload = nlohmann::json::parse(data, nullptr, false);
+    if (payload.is_discarded() || !payload.contains("req_id") || !payload["req_id"].is_string())
+        return false;
+
+    uint32_t req_id;
+    try {
+        req_id = boost::lexical_cast<uint32_t>(payload["req_id"].get<std::string>());
+    }
+    catch (...) {
+        return false;
+    }
+
+    auto ping_it = m_pending_pings.find(req_id);
+    if (ping_it == m_pending_pings.end()) {
+        std::cerr << "web-sock unexpected pong: " << data << std::endl;
+        return true;
+    }
+
+    auto rtt = std::chrono::steady_clock::now() - ping_it->second;
+    m_pending_pings.erase(m_pending_pings.begin(), ++ping_it);
+    m_round_trip.Record(rtt);
+
+    std::clog << "web-sock pong " << req_id << ": " << std::chrono::duration_cast<std::chrono::microseconds>(rtt).count() << "us" << std::endl;
+    return true;
+}
+
+std::string ByBitStream::PingMessage(uint32_t req_id)
+{
+    std::ostringstream buf;
+    buf << R"({"req_id":")" << req_id << R"(","op":"ping"})";
+    return buf.str();
+}
+
+std::string ByBitStream::SubscribeMessage(const OutboundOp& op)
+{
+    std::ostringstream buf;
+    buf << R"({"req_id":")" << ++m_req_counter << R"(","op":")" << (op.subscribe ? "subscribe" : "unsubscribe") << R"(","args":[)";
+    for (const auto& topic: op.topics)
+        buf << "\"" << topic << "\",";
+    buf.seekp(-1, buf.end);
+    buf << "]}";
+    return buf.str();
+}
+
 }
@@ -12,10 +12,15 @@
 #include <iostream>
 
 #include <boost/asio.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/awaitable.hpp>
 #include <boost/beast.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/container/flat_map.hpp>
+
+#include "async_event.hpp"
+#include "latency_histogram.hpp"
+#include "timestamping_stream.hpp"
 
 namespace scratcher::bybit {
 
@@ -23,9 +28,10 @@ namespace ip = boost::asio::ip;
 namespace websock = boost::beast::websocket;
 
 using boost::asio::io_context;
-using boost::asio::yield_context;
+using boost::asio::awaitable;
 
 class ByBitApi;
+struct StreamFrame;
 
 class SubscriptionTopicFormatError : public std::runtime_error
 {
@@ -58,6 +64,7 @@ public:
     SubscriptionTopic(const SubscriptionTopic&) = default;
     SubscriptionTopic(SubscriptionTopic&&) noexcept = default;
 
+    const std::string& Name() const { return m_topic; }
     const std::string_view& Title() const { return m_title; }
     const std::optional<std::string_view>& Symbol() const { return m_symbol; }
     std::optional<size_t> Size() const { return m_size ? std::make_optional<size_t>(boost::lexical_cast<size_t>(*m_size)) : std::optional<size_t>{}; }
@@ -76,43 +83,64 @@ public:
     enum class status {INIT, READY, STALE};
 private:
 
-    using websocket = websock::stream<boost::beast::ssl_stream<boost::beast::tcp_stream>>;
+    using websocket = websock::stream<boost::beast::ssl_stream<TimestampingStream>>;
 
     friend class ByBitApi;
 
+    // Pending subscribe/unsubscribe request, consecutive requests of the same kind are merged into one
+    struct OutboundOp
+    {
+        bool subscribe;
+        std::vector<std::string> topics;
+    };
+
     const std::weak_ptr<ByBitApi> m_api;
     const std::string m_path_spec;
+    const size_t m_shard; // Scheduler shard the connection and its handlers run on
     std::atomic<status> m_status;
 
     boost::asio::strand<websocket::executor_type> m_strand;
     std::unique_ptr<websocket> m_websock;
-    boost::asio::steady_timer m_heartbeat_timer;
-    std::atomic<std::chrono::system_clock::time_point> m_last_heartbeat = std::chrono::system_clock::time_point::min();
+    AsyncEvent m_ready;
+
+    // Single writer state, accessed on m_strand only
+    std::deque<OutboundOp> m_outbound;
+    boost::asio::steady_timer m_writer_timer; // Wakes the writer on a new outbound op or on ping deadline
+    std::chrono::steady_clock::time_point m_last_heartbeat = std::chrono::steady_clock::time_point::min();
+
+    // Ping probes waiting for pong by req_id, accessed on m_strand only
+    const std::chrono::milliseconds m_ping_interval;
+    boost::container::flat_map<uint32_t, std::chrono::steady_clock::time_point> m_pending_pings;
+    LatencyHistogram m_round_trip;
+    LatencyHistogram m_decode_latency;
+    std::atomic_uint64_t m_frames = 0;
+    std::atomic_uint64_t m_socket_reads = 0;
 
     std::atomic_uint32_t m_req_counter = 0;
 
-    std::function<void(std::string&&)> m_data_callback;
+    std::function<void(StreamFrame&&)> m_data_callback;
     std::function<void(boost::system::error_code)> m_error_callback;
 
-    void Heartbeat();
-    void DoOpenWebSocketStream(yield_context yield);
-    void DoReadWebSocketStream(yield_context yield);
+    awaitable<void> DoOpenWebSocketStream();
+    awaitable<void> DoReadWebSocketStream();
+    awaitable<void> DoWriteWebSocketStream();
+
+    void Enqueue(bool subscribe, std::vector<std::string> topics);
+    bool HandlePong(const std::string& data);
 
-    void Message(std::string message);
+    std::string PingMessage(uint32_t req_id);
+    std::string SubscribeMessage(const OutboundOp& op);
 
-    std::string SubscribeMessage(const auto& topics, bool subscribe)
+    static std::vector<std::string> TopicNames(const auto& topics)
     {
-        std::ostringstream buf;
-        buf << R"({"req_id":")" << ++m_req_counter << R"(","op":")" << (subscribe ? "subscribe" : "unsubscribe") << R"(","args":[)";
+        std::vector<std::string> names;
         for (const auto& topic: topics)
-            buf << "\"" << topic << "\",";
-        buf.seekp(-1, buf.end);
-        buf << "]}";
-        return buf.str();
+            names.emplace_back(topic.Name());
+        return names;
     }
 
 public:
-    ByBitStream(std::shared_ptr<ByBitApi> api, std::string spec, std::function<void(std::string&&)> data_callback, std::function<void(boost::system::error_code)> error_callback);
+    ByBitStream(std::shared_ptr<ByBitApi> api, std::string spec, size_t shard, std::function<void(StreamFrame&&)> data_callback, std::function<void(boost::system::error_code)> error_callback);
     ~ByBitStream();
 
 //    static void Create(std::shared_ptr<ByBitApi> api, std::string path_spec, std::string symbol, std::function<void(std::string&&)> callback, std::function<void(boost::system::error_code)> error_callback);
@@ -121,10 +149,28 @@ public:
     status Status() const
     { return m_status; }
 
+    size_t Shard() const
+    { return m_shard; }
+
+    // Websocket ping/pong round trip times of this connection
+    LatencyHistogram::Snapshot RoundTrip() const
+    { return m_round_trip.Snap(); }
+
+    // Time from the kernel receive timestamp to the decoded websocket frame (TLS and websocket processing)
+    LatencyHistogram::Snapshot DecodeLatency() const
+    { return m_decode_latency.Snap(); }
+
+    // Socket reads issued per decoded websocket frame of the current connection
+    double ReadsPerFrame() const
+    {
+        uint64_t frames = m_frames.load(std::memory_order_relaxed);
+        return frames ? static_cast<double>(m_socket_reads.load(std::memory_order_relaxed)) / frames : 0;
+    }
+
     void SubscribeTopics(const auto& topics)
-    { Message(SubscribeMessage(topics, true)); }
-    void UnsubscribeTopics(auto topics)
-    { Message(SubscribeMessage(topics, false)); }
+    { Enqueue(true, TopicNames(topics)); }
+    void UnsubscribeTopics(const auto& topics)
+    { Enqueue(false, TopicNames(topics)); }
 };
 
 }
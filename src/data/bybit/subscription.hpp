@@ -7,24 +7,67 @@
 #ifndef SUBSCRIPTION_HPP
 #define SUBSCRIPTION_HPP
 
+#include <map>
+#include <deque>
+
+#include <boost/asio/strand.hpp>
+
+#include "bybit.hpp"
 #include "bybit/data_manager.hpp"
+#include "latency_histogram.hpp"
 
 namespace scratcher::bybit {
 
+struct FeedLatency
+{
+    LatencyHistogram system; // Exchange frame generation time ("ts") to local receive time
+    LatencyHistogram engine; // Matching engine time ("cts") to local receive time
+};
+
 struct ByBitSubscription
 {
+    // Frames kept until the instrument configuration is loaded, the backlog is dropped above that and the book is resynced
+    static constexpr size_t MAX_BACKLOG = 4096;
+
     const std::string symbol;
 
     std::shared_ptr<ByBitDataManager> dataManager;
 
+    // The data manager strand: all the symbol data is handled and published there,
+    // so symbols are processed in parallel while each one keeps its order
+    DataProvider::strand_type strand;
+    std::deque<StreamFrame> backlog; // Accessed on strand only
+    bool bookReceived = false; // Accessed on strand only
+
+    // Keyed by topic title, all the entries are created here so concurrent lookups need no lock
+    std::map<std::string, FeedLatency, std::less<>> feedLatency;
+
+    ByBitSubscription(std::string symbol, std::shared_ptr<ByBitDataManager> manager)
+        : symbol(move(symbol)), dataManager(move(manager)), strand(dataManager->Strand())
+    {
+        feedLatency.try_emplace("publicTrade");
+        feedLatency.try_emplace("orderbook");
+    }
+
     bool IsReady() const
     { return dataManager && dataManager->IsReadyHandleData(); }
 
-    void Handle(const SubscriptionTopic& topic, const std::string& type, const nlohmann::json& payload)
-    { if (dataManager) dataManager->HandleData(topic, type, payload); }
+    void Handle(const SubscriptionTopic& topic, const std::string& type, const nlohmann::json& payload, time received)
+    { if (dataManager) dataManager->HandleData(topic, type, payload, received); }
 
     void HandleError(boost::system::error_code ec)
     { if (dataManager) dataManager->HandleError(ec);}
+
+    void RecordLatency(std::string_view title, std::chrono::system_clock::time_point server_received, const nlohmann::json& frame)
+    {
+        auto it = feedLatency.find(title);
+        if (it == feedLatency.end()) return;
+
+        if (frame.contains("ts") && frame["ts"].is_number())
+            it->second.system.Record(server_received - std::chrono::system_clock::time_point(std::chrono::milliseconds(frame["ts"].get<int64_t>())));
+        if (frame.contains("cts") && frame["cts"].is_number())
+            it->second.engine.Record(server_received - std::chrono::system_clock::time_point(std::chrono::milliseconds(frame["cts"].get<int64_t>())));
+    }
 };
 
 
@@ -0,0 +1,106 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "clock_sync.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace scratcher {
+
+namespace {
+
+// Frequency tolerance used by NTP to grow the error bound with the estimate age
+const double DISPERSION_RATE = 15e-6;
+// Drift is not estimated from the samples which span less than that
+const std::chrono::seconds MIN_DRIFT_SPAN = std::chrono::seconds(60);
+const size_t MIN_DRIFT_SAMPLES = 4;
+const double MAX_DRIFT = 500e-6;
+
+int64_t to_ns(std::chrono::system_clock::time_point t)
+{ return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count(); }
+
+}
+
+void ClockSync::AddSample(time_point sent, time_point server, time_point received, duration server_resolution)
+{
+    if (received < sent) return;
+
+    auto delay = std::chrono::duration_cast<duration>(received - sent);
+    time_point local = sent + std::chrono::duration_cast<time_point::duration>(delay / 2);
+
+    Sample sample {local, std::chrono::duration_cast<duration>(server - local), delay, delay / 2 + server_resolution};
+
+    std::unique_lock lock(m_samples_mutex);
+
+    m_samples.push_back(sample);
+    if (m_samples.size() > WINDOW_SIZE)
+        m_samples.pop_front();
+    ++m_sample_count;
+
+    auto filter_begin = m_samples.size() > FILTER_SIZE ? m_samples.end() - FILTER_SIZE : m_samples.begin();
+    const Sample& best = *std::min_element(filter_begin, m_samples.end(), [](const auto& a, const auto& b) { return a.error < b.error; });
+
+    Estimate estimate {
+        .anchor_ns = to_ns(best.local),
+        .offset_ns = best.offset.count(),
+        .error_ns = best.error.count(),
+        .drift = CalcDrift(),
+        .samples = m_sample_count
+    };
+    m_estimate.Store(estimate);
+
+    std::clog << "clock sync: offset " << std::chrono::duration_cast<std::chrono::microseconds>(best.offset).count()
+              << "us, error " << std::chrono::duration_cast<std::chrono::microseconds>(best.error).count()
+              << "us, rtt " << std::chrono::duration_cast<std::chrono::microseconds>(sample.delay).count()
+              << "us, drift " << estimate.drift * 1e6 << "ppm" << std::endl;
+}
+
+double ClockSync::CalcDrift() const
+{
+    if (m_samples.size() < MIN_DRIFT_SAMPLES) return 0;
+    if (m_samples.back().local - m_samples.front().local < MIN_DRIFT_SPAN) return 0;
+
+    // Only the samples close to the lowest error bound take part, queueing delays are asymmetric noise
+    auto min_error = std::min_element(m_samples.begin(), m_samples.end(), [](const auto& a, const auto& b) { return a.error < b.error; })->error;
+    auto max_error = min_error + min_error / 2;
+
+    const auto& origin = m_samples.front().local;
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (const auto& s: m_samples) {
+        if (s.error > max_error) continue;
+        double x = std::chrono::duration<double>(s.local - origin).count();
+        double y = std::chrono::duration<double>(s.offset).count();
+        n += 1; sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+
+    double denominator = n * sxx - sx * sx;
+    if (n < MIN_DRIFT_SAMPLES || denominator <= 0) return 0;
+
+    double drift = (n * sxy - sx * sy) / denominator;
+    return std::clamp(drift, -MAX_DRIFT, MAX_DRIFT);
+}
+
+std::optional<ClockSync::duration> ClockSync::Offset(time_point local) const
+{
+    Estimate e = m_estimate.Load();
+    if (!e.samples) return {};
+
+    double age = static_cast<double>(to_ns(local) - e.anchor_ns);
+    return duration(e.offset_ns + static_cast<int64_t>(e.drift * age));
+}
+
+std::optional<ClockSync::duration> ClockSync::ErrorBound(time_point local) const
+{
+    Estimate e = m_estimate.Load();
+    if (!e.samples) return {};
+
+    double age = std::abs(static_cast<double>(to_ns(local) - e.anchor_ns));
+    return duration(e.error_ns + static_cast<int64_t>(DISPERSION_RATE * age));
+}
+
+}
@@ -0,0 +1,88 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef CLOCK_SYNC_HPP
+#define CLOCK_SYNC_HPP
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "seqlock.hpp"
+
+namespace scratcher {
+
+struct ClockEstimate
+{
+    int64_t anchor_ns = 0;   // Local time of the sample the estimate is based on
+    int64_t offset_ns = 0;   // Server minus local clock at the anchor time
+    int64_t error_ns = 0;    // Error bound at the anchor time
+    double drift = 0;        // Offset change per local second, s/s
+    uint64_t samples = 0;    // 0 means no estimate yet
+};
+
+// NTP-like estimation of a remote clock offset from request/response samples.
+//
+// Each sample gives offset = server - (sent + received)/2 with the error bound of half the round trip
+// plus the server timestamp resolution. The estimate is taken from the lowest error bound sample among the recent ones
+// (clock filter), so a coarse timestamp does not win by a slightly shorter round trip.
+// The local clock drift is the least squares slope of the low error samples over the whole window.
+// The error bound of the published estimate grows with its age by the NTP dispersion rate.
+class ClockSync
+{
+public:
+    typedef std::chrono::system_clock::time_point time_point;
+    typedef std::chrono::nanoseconds duration;
+
+    typedef ClockEstimate Estimate;
+
+    static constexpr size_t WINDOW_SIZE = 64;
+    static constexpr size_t FILTER_SIZE = 8;
+
+private:
+    struct Sample
+    {
+        time_point local;   // Round trip middle point
+        duration offset;
+        duration delay;
+        duration error;
+    };
+
+    std::mutex m_samples_mutex;
+    std::deque<Sample> m_samples;
+    uint64_t m_sample_count = 0;
+
+    Seqlock<Estimate> m_estimate;
+
+    double CalcDrift() const;
+
+public:
+    ClockSync() = default;
+
+    // server_resolution is the precision of the server timestamp (i.e. 1ms for millisecond timestamps)
+    void AddSample(time_point sent, time_point server, time_point received, duration server_resolution = duration(0));
+
+    Estimate Current() const
+    { return m_estimate.Load(); }
+
+    bool IsSynced() const
+    { return m_estimate.Version() != 0; }
+
+    // Server minus local clock extrapolated to the local time point
+    std::optional<duration> Offset(time_point local) const;
+    std::optional<duration> ErrorBound(time_point local) const;
+
+    std::optional<time_point> ServerTime(time_point local) const
+    {
+        auto offset = Offset(local);
+        return offset ? std::make_optional(local + std::chrono::duration_cast<time_point::duration>(*offset)) : std::nullopt;
+    }
+};
+
+}
+
+#endif //CLOCK_SYNC_HPP
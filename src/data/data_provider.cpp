@@ -6,5 +6,69 @@
 
 #include "data_provider.hpp"
 
+#include <algorithm>
+
 namespace scratcher {
+
+void DataProvider::UpdateCandle(const Trade& trade)
+{
+    time open_time = std::chrono::floor<std::chrono::minutes>(trade.trade_time);
+
+    if (!m_candles.empty() && open_time < m_candles.back().open_time)
+        return; // Late trade of an already closed candle
+
+    if (m_candles.empty() || open_time > m_candles.back().open_time) {
+        if (!m_candles.empty()) {
+            m_candles.back().closed = true;
+            Publish(m_candles.back());
+            CandleClosed(m_candles.back());
+        }
+        if (m_candles.size() == CANDLE_HISTORY)
+            m_candles.pop_front();
+
+        m_candles.push_back({open_time, trade.price_points, trade.price_points, trade.price_points, trade.price_points, 0, 0, false});
+    }
+
+    Candle& candle = m_candles.back();
+    candle.high_points = std::max(candle.high_points, trade.price_points);
+    candle.low_points = std::min(candle.low_points, trade.price_points);
+    candle.close_points = trade.price_points;
+    candle.volume_points += trade.volume_points;
+    ++candle.trade_count;
+
+    Publish(candle);
+}
+
+void DataProvider::ResetData()
+{
+    std::apply([](auto&... lists) {
+        auto disconnect = [](auto& subscribers) {
+            for (const auto& ref: subscribers)
+                if (auto queue = ref.lock()) queue->Disconnect();
+            subscribers.clear();
+        };
+        (disconnect(lists), ...);
+    }, m_subscribers);
+
+    m_candles.clear();
+    m_state_draft = {};
+    m_state.Store(m_state_draft);
+}
+
+std::vector<ConsumerStats> DataProvider::Consumers()
+{
+    std::vector<ConsumerStats> res;
+    std::unique_lock lock(m_consumers_mutex);
+    for (const auto& ref: m_consumers)
+        if (auto queue = ref.lock())
+            res.emplace_back(queue->Stats());
+    return res;
+}
+
+void DataProvider::Snapshot(EventQueue<Candle>& queue)
+{
+    for (const auto& candle: m_candles)
+        queue.Push(candle);
+}
+
 } // scratcher
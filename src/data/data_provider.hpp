@@ -8,9 +8,24 @@
 #define DATA_PROVIDER_HPP
 
 #include "currency.hpp"
+#include "seqlock.hpp"
+#include "latency_histogram.hpp"
 
+#include <array>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 
 namespace scratcher {
 
@@ -29,7 +44,343 @@ struct Trade
     TradeSide side;
 };
 
-class DataProvider {
+struct BookLevel
+{
+    uint64_t price_points;
+    uint64_t volume_points; // 0 removes the level in a delta update
+};
+
+struct OrderBookUpdate
+{
+    bool snapshot;          // Replaces the whole book if set, otherwise changed levels only
+    uint64_t update_id;
+    time received;          // Local time the update was received from the exchange
+    std::vector<BookLevel> bids;
+    std::vector<BookLevel> asks;
+};
+
+struct Candle
+{
+    time open_time;
+    uint64_t open_points;
+    uint64_t high_points;
+    uint64_t low_points;
+    uint64_t close_points;
+    uint64_t volume_points;
+    uint32_t trade_count;
+    bool closed;            // Updates of the current candle are published with closed = false
+};
+
+// Latest state of an instrument in a fixed layout, published through a seqlock for polling readers
+struct MarketState
+{
+    BookLevel best_bid {};
+    BookLevel best_ask {};
+    uint64_t book_update_id = 0;
+
+    time last_trade_time {};
+    uint64_t last_trade_price_points = 0;
+    uint64_t last_trade_volume_points = 0;
+    TradeSide last_trade_side = TradeSide::BUY;
+
+    Candle candle {};       // Current 1 minute candle
+};
+
+// Value of a derived indicator calculated off the I/O threads
+struct AnalyticsResult
+{
+    uint32_t indicator; // Caller defined indicator id
+    time calculated_at;
+    double value;
+};
+
+enum class ConsumerPolicy: uint8_t {
+    LOSSLESS,   // Bounded buffer, the consumer is disconnected on overflow and has to resubscribe with a snapshot
+    CONFLATE,   // Only the latest event is kept, suits state-like events (i.e. the current candle)
+    DROP        // New events are dropped while the buffer is full
+};
+
+// Delivery statistics of a consumer, lag is the time events spend in the queue
+struct ConsumerStats
+{
+    std::string name;
+    ConsumerPolicy policy;
+    uint64_t delivered;
+    uint64_t dropped;       // Dropped on a full buffer, or replaced by a newer event for CONFLATE
+    size_t backlog;         // Events waiting to be drained
+    size_t max_backlog;
+    bool overflowed;
+    LatencyHistogram::Snapshot lag;
+};
+
+// Type independent part of a consumer queue, used for lag reporting
+class EventQueueBase
+{
+protected:
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    const std::string m_name;
+    const ConsumerPolicy m_policy;
+    const std::function<void()> m_notify;
+    std::atomic<bool> m_notify_pending = false;
+    std::atomic<bool> m_overflowed = false;
+
+    std::atomic<uint64_t> m_pushed = 0;
+    std::atomic<uint64_t> m_delivered = 0;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<size_t> m_max_backlog = 0;
+    LatencyHistogram m_lag;
+
+    EventQueueBase(std::string name, ConsumerPolicy policy, std::function<void()> notify)
+        : m_name(std::move(name)), m_policy(policy), m_notify(std::move(notify))
+    {}
+
+    void Notify()
+    {
+        if (m_notify && !m_notify_pending.exchange(true, std::memory_order_acq_rel))
+            m_notify();
+    }
+
+    void Delivered(time_point enqueued, time_point now)
+    {
+        m_lag.Record(now - enqueued);
+        m_delivered.fetch_add(1, std::memory_order_relaxed);
+    }
+
+public:
+    virtual ~EventQueueBase() = default;
+
+    const std::string& Name() const
+    { return m_name; }
+
+    // LOSSLESS consumer has fallen behind the buffer size, or the provider has reset its data (see Disconnect()).
+    // The queue gets no more events either way, the consumer is to resubscribe for a fresh snapshot
+    bool Overflowed() const
+    { return m_overflowed.load(std::memory_order_acquire); }
+
+    // Called by the provider when the events delivered so far are no longer valid (i.e. the points have changed)
+    void Disconnect()
+    {
+        m_overflowed.store(true, std::memory_order_release);
+        Notify();
+    }
+
+    uint64_t Dropped() const
+    { return m_dropped.load(std::memory_order_relaxed); }
+
+    ConsumerStats Stats() const
+    {
+        uint64_t pushed = m_pushed.load(std::memory_order_relaxed);
+        uint64_t delivered = m_delivered.load(std::memory_order_relaxed);
+        return {m_name, m_policy, delivered, Dropped(), pushed > delivered ? size_t(pushed - delivered) : 0,
+                m_max_backlog.load(std::memory_order_relaxed), Overflowed(), m_lag.Snap()};
+    }
+};
+
+// Consumer end of a data provider subscription: a single producer/single consumer ring.
+// The provider pushes events from its strand and never waits, a full ring is handled according to the policy.
+// The notify callback is called by the producer when the queue turns non-empty, it is expected to schedule
+// Drain() on the consumer thread (i.e. post to the consumer's event loop) and must not block.
+template <typename Event>
+class EventQueue: public EventQueueBase
+{
+    struct Entry
+    {
+        Event event;
+        time_point enqueued;
+    };
+
+    boost::lockfree::spsc_queue<Entry> m_ring;
+
+    // CONFLATE triple buffer: the producer fills its back slot and swaps it with the middle one, the consumer swaps
+    // its front slot with the middle one if that has a fresh entry. Slots are reused, so a push does not allocate
+    // (an event with vectors reuses their capacity once it has grown).
+    static constexpr uint8_t SLOT_FRESH = 4;
+    std::array<Entry, 3> m_slots {};
+    std::atomic<uint8_t> m_middle_slot = 1; // Slot index | SLOT_FRESH
+    uint8_t m_back_slot = 0;    // Producer only
+    uint8_t m_front_slot = 2;   // Consumer only
+
+public:
+    EventQueue(std::string name, ConsumerPolicy policy, size_t capacity, std::function<void()> notify)
+        : EventQueueBase(std::move(name), policy, std::move(notify)), m_ring(policy == ConsumerPolicy::CONFLATE ? 1 : capacity)
+    {}
+
+    // Producer side
+    void Push(const Event& event)
+    {
+        if (Overflowed()) return;
+
+        auto now = std::chrono::steady_clock::now();
+        if (m_policy == ConsumerPolicy::CONFLATE) {
+            Entry& slot = m_slots[m_back_slot];
+            slot.event = event;
+            slot.enqueued = now;
+
+            uint8_t replaced = m_middle_slot.exchange(m_back_slot | SLOT_FRESH, std::memory_order_acq_rel);
+            m_back_slot = replaced & ~SLOT_FRESH;
+            if (replaced & SLOT_FRESH)
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+            else
+                m_pushed.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (m_ring.push(Entry{event, now})) {
+            auto backlog = m_pushed.fetch_add(1, std::memory_order_relaxed) + 1 - m_delivered.load(std::memory_order_relaxed);
+            if (backlog > m_max_backlog.load(std::memory_order_relaxed))
+                m_max_backlog.store(backlog, std::memory_order_relaxed);
+        }
+        else {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            if (m_policy == ConsumerPolicy::LOSSLESS)
+                m_overflowed.store(true, std::memory_order_release);
+            else
+                return;
+        }
+        Notify();
+    }
+
+    // Consumer side, returns the number of events handled.
+    // The handler may take the enqueue time as the second argument, it orders events of different queues of a provider
+    template <typename F>
+    size_t Drain(F&& handler)
+    {
+        auto handle = [&handler](const Entry& entry) {
+            if constexpr (std::is_invocable_v<F&, const Event&, time_point>)
+                handler(entry.event, entry.enqueued);
+            else
+                handler(entry.event);
+        };
+
+        m_notify_pending.store(false, std::memory_order_release);
+
+        if (m_policy == ConsumerPolicy::CONFLATE) {
+            // Only the producer sets the fresh flag, so it is still there at the exchange if seen here
+            if (!(m_middle_slot.load(std::memory_order_relaxed) & SLOT_FRESH)) return 0;
+            m_front_slot = m_middle_slot.exchange(m_front_slot, std::memory_order_acq_rel) & ~SLOT_FRESH;
+
+            const Entry& latest = m_slots[m_front_slot];
+            Delivered(latest.enqueued, std::chrono::steady_clock::now());
+            handle(latest);
+            return 1;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        return m_ring.consume_all([&](const Entry& entry) {
+            Delivered(entry.enqueued, now);
+            handle(entry);
+        });
+    }
+};
+
+// Typed publish/subscribe surface of market data.
+// Events are published and subscribers are registered on the provider strand only, so neither needs a lock.
+// A subscriber is removed by dropping its queue, an overflowed LOSSLESS subscriber is removed by the provider.
+class DataProvider: public std::enable_shared_from_this<DataProvider> {
+public:
+    typedef boost::asio::strand<boost::asio::any_io_executor> strand_type;
+
+    static constexpr size_t CANDLE_HISTORY = 1440; // 1 minute candles kept for snapshots
+
+private:
+    strand_type m_strand;
+
+    template <typename Event>
+    using subscriber_list = std::vector<std::weak_ptr<EventQueue<Event>>>;
+
+    std::tuple<subscriber_list<Trade>, subscriber_list<OrderBookUpdate>, subscriber_list<Candle>> m_subscribers;
+
+    std::mutex m_consumers_mutex;
+    std::vector<std::weak_ptr<EventQueueBase>> m_consumers; // All the subscribers, for lag reporting
+
+    std::deque<Candle> m_candles; // The last one is the current candle
+
+    MarketState m_state_draft;  // Accessed on the strand only
+    Seqlock<MarketState> m_state;
+
+    void UpdateCandle(const Trade& trade);
+
+protected:
+    explicit DataProvider(strand_type strand) : m_strand(std::move(strand)) {}
+
+    template <typename Event>
+    void Publish(const Event& event)
+    {
+        auto& subscribers = std::get<subscriber_list<Event>>(m_subscribers);
+        std::erase_if(subscribers, [&event](const auto& ref) {
+            auto queue = ref.lock();
+            if (queue) queue->Push(event);
+            return !queue || queue->Overflowed();
+        });
+
+        if constexpr (std::is_same_v<Event, Trade>) {
+            m_state_draft.last_trade_time = event.trade_time;
+            m_state_draft.last_trade_price_points = event.price_points;
+            m_state_draft.last_trade_volume_points = event.volume_points;
+            m_state_draft.last_trade_side = event.side;
+            UpdateCandle(event);
+            m_state_draft.candle = m_candles.back();
+            m_state.Store(m_state_draft);
+        }
+    }
+
+    // Drops the candles and the state, and disconnects all the subscribers, so they resubscribe for a snapshot
+    // of the new data. Called by the implementation when the meaning of the price or volume points has changed
+    void ResetData();
+
+    // The book itself is kept by the implementation, so it reports the top levels here after applying an update
+    void UpdateTopOfBook(BookLevel best_bid, BookLevel best_ask, uint64_t update_id)
+    {
+        m_state_draft.best_bid = best_bid;
+        m_state_draft.best_ask = best_ask;
+        m_state_draft.book_update_id = update_id;
+        m_state.Store(m_state_draft);
+    }
+
+    // Called on the provider strand when a candle closes, before the next one is opened in Candles()
+    virtual void CandleClosed(const Candle& candle) {}
+    const std::deque<Candle>& Candles() const
+    { return m_candles; }
+
+    // Current state for a new subscriber, called on the provider strand
+    virtual void Snapshot(EventQueue<Trade>& queue) {}
+    virtual void Snapshot(EventQueue<OrderBookUpdate>& queue) {}
+    virtual void Snapshot(EventQueue<Candle>& queue);
+
+public:
+    virtual ~DataProvider() = default;
+
+    const strand_type& Strand() const
+    { return m_strand; }
+
+    // Never waits for the writer, safe to call from any thread at any rate
+    MarketState State() const
+    { return m_state.Load(); }
+    // Changes on every state update, so a poller can skip State() when nothing has changed
+    uint64_t StateVersion() const
+    { return m_state.Version(); }
+
+    template <typename Event>
+    std::shared_ptr<EventQueue<Event>> Subscribe(std::string name, ConsumerPolicy policy, size_t capacity, std::function<void()> notify = {}, bool with_snapshot = false)
+    {
+        auto queue = std::make_shared<EventQueue<Event>>(std::move(name), policy, capacity, std::move(notify));
+        {
+            std::unique_lock lock(m_consumers_mutex);
+            std::erase_if(m_consumers, [](const auto& ref) { return ref.expired(); });
+            m_consumers.emplace_back(queue);
+        }
+
+        // The snapshot is pushed before any live event, so the consumer sees a consistent sequence
+        boost::asio::dispatch(m_strand, [ref = weak_from_this(), queue, with_snapshot] {
+            if (auto self = ref.lock()) {
+                if (with_snapshot) self->Snapshot(*queue);
+                std::get<subscriber_list<Event>>(self->m_subscribers).emplace_back(queue);
+            }
+        });
+        return queue;
+    }
+
+    // Delivery statistics of the live subscribers, to find the one falling behind
+    std::vector<ConsumerStats> Consumers();
 };
 
 
@@ -0,0 +1,203 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "endpoint_pool.hpp"
+
+#include <algorithm>
+#include <memory>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/this_coro.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace scratcher {
+
+void EndpointPool::Update(const boost::asio::ip::tcp::resolver::results_type& results)
+{
+    std::vector<EndpointStats> endpoints;
+    endpoints.reserve(results.size());
+
+    std::unique_lock lock(m_mutex);
+    for (const auto& entry: results) {
+        auto endpoint = entry.endpoint();
+        if (std::any_of(endpoints.begin(), endpoints.end(), [&](const auto& e) { return e.endpoint == endpoint; })) continue;
+
+        auto known = std::find_if(m_endpoints.begin(), m_endpoints.end(), [&](const auto& e) { return e.endpoint == endpoint; });
+        endpoints.push_back(known != m_endpoints.end() ? *known : EndpointStats{endpoint});
+    }
+    m_endpoints = move(endpoints);
+}
+
+bool EndpointPool::Empty() const
+{
+    std::unique_lock lock(m_mutex);
+    return m_endpoints.empty();
+}
+
+std::vector<boost::asio::ip::tcp::endpoint> EndpointPool::Ranked() const
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::pair<int, const EndpointStats*>> ranked;
+
+    std::unique_lock lock(m_mutex);
+    ranked.reserve(m_endpoints.size());
+    for (const auto& e: m_endpoints) {
+        int group = (e.last_failure && now - *e.last_failure < FAILURE_PENALTY) ? 2 : (e.connect_latency ? 0 : 1);
+        ranked.emplace_back(group, &e);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        if (a.first != b.first) return a.first < b.first;
+        return a.first == 0 && *a.second->connect_latency < *b.second->connect_latency;
+    });
+
+    std::vector<boost::asio::ip::tcp::endpoint> res;
+    res.reserve(ranked.size());
+    for (const auto& r: ranked) res.push_back(r.second->endpoint);
+    return res;
+}
+
+void EndpointPool::ReportConnected(const boost::asio::ip::tcp::endpoint& endpoint, std::chrono::nanoseconds latency)
+{
+    std::unique_lock lock(m_mutex);
+    auto it = std::find_if(m_endpoints.begin(), m_endpoints.end(), [&](const auto& e) { return e.endpoint == endpoint; });
+    if (it == m_endpoints.end()) return; // Re-resolved meanwhile
+
+    ++it->connects;
+    it->last_failure.reset();
+    if (it->connect_latency)
+        it->connect_latency = std::chrono::nanoseconds(static_cast<int64_t>(LATENCY_WEIGHT * latency.count() + (1 - LATENCY_WEIGHT) * it->connect_latency->count()));
+    else
+        it->connect_latency = latency;
+}
+
+void EndpointPool::ReportFailed(const boost::asio::ip::tcp::endpoint& endpoint)
+{
+    std::unique_lock lock(m_mutex);
+    auto it = std::find_if(m_endpoints.begin(), m_endpoints.end(), [&](const auto& e) { return e.endpoint == endpoint; });
+    if (it == m_endpoints.end()) return;
+
+    ++it->failures;
+    it->last_failure = std::chrono::steady_clock::now();
+}
+
+std::vector<EndpointStats> EndpointPool::Stats() const
+{
+    std::unique_lock lock(m_mutex);
+    return m_endpoints;
+}
+
+namespace {
+
+struct ConnectAttempt
+{
+    boost::asio::ip::tcp::socket socket;
+    boost::asio::ip::tcp::endpoint endpoint;
+    std::chrono::steady_clock::time_point started;
+    bool done = false;
+    boost::system::error_code error;
+
+    ConnectAttempt(boost::asio::any_io_executor executor, boost::asio::ip::tcp::endpoint endpoint)
+        : socket(std::move(executor)), endpoint(std::move(endpoint)), started(std::chrono::steady_clock::now())
+    {}
+};
+
+// Runs on a strand together with all the connect handlers, so the attempts state needs no lock
+// Returns optional since co_spawn needs a default constructible result
+boost::asio::awaitable<std::optional<boost::asio::ip::tcp::socket>> DoRaceConnect(EndpointPool& pool, std::vector<boost::asio::ip::tcp::endpoint> endpoints,
+                                                                                  SocketOptions options, std::chrono::milliseconds stagger,
+                                                                                  std::chrono::steady_clock::duration timeout)
+{
+    auto executor = co_await boost::asio::this_coro::executor;
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+
+    std::vector<std::unique_ptr<ConnectAttempt>> attempts;
+    boost::asio::steady_timer wake(executor); // Cancelled by each completed attempt
+    boost::system::error_code ec;
+
+    auto start = [&](const boost::asio::ip::tcp::endpoint& endpoint) {
+        auto& attempt = *attempts.emplace_back(std::make_unique<ConnectAttempt>(executor, endpoint));
+
+        boost::system::error_code error;
+        attempt.socket.open(endpoint.protocol(), error);
+        if (error) {
+            attempt.done = true;
+            attempt.error = error;
+            pool.ReportFailed(endpoint);
+            return;
+        }
+        ApplyBufferSizes(attempt.socket, options);
+
+        attempt.socket.async_connect(endpoint, boost::asio::bind_executor(executor, [&attempt, &wake, &pool](boost::system::error_code error) {
+            attempt.done = true;
+            attempt.error = error;
+            if (!error)
+                pool.ReportConnected(attempt.endpoint, std::chrono::steady_clock::now() - attempt.started);
+            else if (error != boost::asio::error::operation_aborted)
+                pool.ReportFailed(attempt.endpoint);
+            wake.cancel();
+        }));
+    };
+
+    ConnectAttempt* winner = nullptr;
+    size_t next = 0;
+    auto next_start = std::chrono::steady_clock::now();
+    for (;;) {
+        auto now = std::chrono::steady_clock::now();
+        bool running = false;
+        for (auto& attempt: attempts) {
+            if (attempt->done && !attempt->error && !winner) winner = attempt.get();
+            running |= !attempt->done;
+        }
+        if (winner || now >= deadline) break;
+
+        if (next < endpoints.size() && (!running || now >= next_start)) {
+            start(endpoints[next++]);
+            next_start = now + stagger;
+            continue;
+        }
+        if (!running) break; // All the addresses have failed
+
+        wake.expires_at(next < endpoints.size() ? std::min(next_start, deadline) : deadline);
+        co_await wake.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    }
+
+    // The handlers refer to the attempts, so they all must complete before return
+    for (auto& attempt: attempts) {
+        if (!attempt->done && attempt.get() != winner) {
+            boost::system::error_code ignore;
+            attempt->socket.close(ignore);
+        }
+    }
+    while (std::any_of(attempts.begin(), attempts.end(), [](const auto& a) { return !a->done; })) {
+        wake.expires_at(boost::asio::steady_timer::time_point::max());
+        co_await wake.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    }
+
+    if (winner) co_return std::make_optional(std::move(winner->socket));
+
+    for (auto it = attempts.rbegin(); it != attempts.rend(); ++it)
+        if (it->get()->error && it->get()->error != boost::asio::error::operation_aborted) throw it->get()->error;
+    throw boost::system::error_code(boost::asio::error::timed_out);
+}
+
+}
+
+boost::asio::awaitable<boost::asio::ip::tcp::socket> RaceConnect(EndpointPool& pool, const SocketOptions& options, std::chrono::milliseconds stagger,
+                                                                 std::chrono::steady_clock::duration timeout)
+{
+    auto endpoints = pool.Ranked();
+    if (endpoints.empty()) throw boost::system::error_code(boost::asio::error::host_not_found);
+
+    auto strand = boost::asio::make_strand(co_await boost::asio::this_coro::executor);
+    auto socket = co_await boost::asio::co_spawn(strand, DoRaceConnect(pool, move(endpoints), options, stagger, timeout), boost::asio::use_awaitable);
+    co_return std::move(*socket);
+}
+
+}
@@ -0,0 +1,67 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef ENDPOINT_POOL_HPP
+#define ENDPOINT_POOL_HPP
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "socket_options.hpp"
+
+namespace scratcher {
+
+struct EndpointStats
+{
+    boost::asio::ip::tcp::endpoint endpoint;
+    std::optional<std::chrono::nanoseconds> connect_latency; // Exponentially weighted average of the successful connects
+    uint64_t connects = 0;
+    uint64_t failures = 0;
+    std::optional<std::chrono::steady_clock::time_point> last_failure;
+};
+
+// Resolved addresses of a host with their connect statistics. The set is replaced on each re-resolution,
+// the statistics of the addresses which stay in it are kept. All the methods may be called from any thread.
+class EndpointPool
+{
+public:
+    static constexpr double LATENCY_WEIGHT = 0.25;  // Weight of a new sample in the average
+    static constexpr std::chrono::seconds FAILURE_PENALTY {30}; // An address failed that recently is tried last
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<EndpointStats> m_endpoints;
+
+public:
+    void Update(const boost::asio::ip::tcp::resolver::results_type& results);
+
+    bool Empty() const;
+
+    // Healthy addresses by the average connect latency first, then the not measured ones in the resolver order,
+    // then the recently failed ones
+    std::vector<boost::asio::ip::tcp::endpoint> Ranked() const;
+
+    void ReportConnected(const boost::asio::ip::tcp::endpoint& endpoint, std::chrono::nanoseconds latency);
+    void ReportFailed(const boost::asio::ip::tcp::endpoint& endpoint);
+
+    std::vector<EndpointStats> Stats() const;
+};
+
+// Happy Eyeballs (RFC 8305) style connect: the ranked addresses are tried one after another with the stagger delay
+// between the attempts, the next one starts at once if all the running attempts have failed.
+// The first connected socket wins, the other attempts are cancelled. Connect times and failures go to the pool stats.
+// The buffer sizes of the options are applied before connect, the rest is left to the caller.
+boost::asio::awaitable<boost::asio::ip::tcp::socket> RaceConnect(EndpointPool& pool, const SocketOptions& options, std::chrono::milliseconds stagger,
+                                                                 std::chrono::steady_clock::duration timeout);
+
+}
+
+#endif //ENDPOINT_POOL_HPP
@@ -0,0 +1,353 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "history_store.hpp"
+#include "tick_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <numeric>
+
+namespace scratcher {
+
+namespace {
+
+const char* const COMPRESSED_EXT = ".tickz";
+const char* const COLUMNS_EXT = ".cols";
+// Raw segments of a day: the live one, the late records and the late records being compressed
+const char* const RAW_EXTS[] = {JOURNAL_SEGMENT_EXT, JOURNAL_LATE_EXT, JOURNAL_MERGE_EXT};
+
+bool IsRawSegment(const std::filesystem::path& path)
+{ return std::ranges::find(RAW_EXTS, path.extension()) != std::end(RAW_EXTS); }
+
+// The committed size of a raw segment, its file size does not change while the preallocated space is filled
+uint64_t JournalSourceSize(const std::filesystem::directory_entry& entry, bool* sealed = nullptr)
+{
+    if (!IsRawSegment(entry.path())) return entry.file_size();
+
+    JournalHeader header;
+    std::ifstream file(entry.path(), std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return 0;
+    if (sealed) *sealed = header.sealed.load(std::memory_order_relaxed) != 0;
+    return sizeof(header) + header.committed.load(std::memory_order_relaxed) * sizeof(JournalRecord);
+}
+
+time FromJournalTimeNs(int64_t time_ns)
+{
+    return std::chrono::time_point_cast<time::duration>(
+        std::chrono::utc_clock::from_sys(std::chrono::sys_time<std::chrono::nanoseconds>(std::chrono::nanoseconds(time_ns))));
+}
+
+size_t Padded(size_t size)
+{ return (size + 7) & ~size_t(7); }
+
+template <typename T>
+void WriteColumn(std::ofstream& file, const std::vector<T>& column)
+{ file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T)); }
+
+// Puts the rows listed in the order to the column from the first row on
+template <typename T>
+void Reorder(std::vector<T>& column, size_t first, const std::vector<size_t>& order)
+{
+    std::vector<T> moved;
+    moved.reserve(order.size());
+    for (size_t row: order) moved.push_back(column[row]);
+    std::copy(moved.begin(), moved.end(), column.begin() + first);
+}
+
+}
+
+size_t HistoryStore::Segment::LowerBound(int64_t time_ns) const
+{
+    auto entry = std::lower_bound(index.begin(), index.end(), time_ns, [](const HistoryIndexEntry& e, int64_t t) { return e.time_ns < t; });
+    size_t begin = entry == index.begin() ? 0 : (entry - 1)->row;
+    size_t end = entry == index.end() ? columns.size() : entry->row;
+    return std::lower_bound(columns.time_ns.begin() + begin, columns.time_ns.begin() + end, time_ns) - columns.time_ns.begin();
+}
+
+void HistoryStore::Segment::AppendLive(const std::filesystem::path& journal_path)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(journal_path, ec);
+    if (ec || size <= sizeof(JournalHeader)) return;
+
+    boost::interprocess::file_mapping file(journal_path.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_only, 0, size);
+    auto records = CommittedRecords(region.get_address(), region.get_size());
+    if (records.size() <= live_position) return;
+
+    size_t merged = live_time_ns.size();
+    for (const auto& record: records.subspan(live_position)) {
+        if (record.type != JournalRecordType::TRADE) continue;
+        live_time_ns.push_back(record.time_ns);
+        live_price_points.push_back(record.price_points);
+        live_volume_points.push_back(record.volume_points);
+        live_side.push_back(record.side);
+    }
+    live_position = records.size();
+
+    // A trade may come a bit out of order after a resubscription. The new rows are sorted and merged
+    // with the rows they overlap at once, the arrival order is kept for equal times
+    auto tail = live_time_ns.begin() + merged;
+    if (!std::is_sorted(tail, live_time_ns.end()) || (merged && tail != live_time_ns.end() && *(tail - 1) > *tail)) {
+        size_t first = std::upper_bound(live_time_ns.begin(), tail, *std::min_element(tail, live_time_ns.end())) - live_time_ns.begin();
+
+        auto by_time = [this](size_t a, size_t b) { return live_time_ns[a] < live_time_ns[b]; };
+        std::vector<size_t> order(live_time_ns.size() - first);
+        std::iota(order.begin(), order.end(), first);
+        std::stable_sort(order.begin() + (merged - first), order.end(), by_time);
+        std::inplace_merge(order.begin(), order.begin() + (merged - first), order.end(), by_time);
+
+        Reorder(live_time_ns, first, order);
+        Reorder(live_price_points, first, order);
+        Reorder(live_volume_points, first, order);
+        Reorder(live_side, first, order);
+
+        // Index entries before the first moved row stay valid
+        std::erase_if(live_index, [first](const HistoryIndexEntry& entry) { return entry.row >= first; });
+    }
+
+    size_t indexed = live_index.empty() ? 0 : live_index.back().row + INDEX_STRIDE;
+    for (size_t row = indexed; row < live_time_ns.size(); row += INDEX_STRIDE)
+        live_index.push_back({live_time_ns[row], row});
+
+    columns = {live_time_ns, live_price_points, live_volume_points, live_side};
+    index = live_index;
+}
+
+HistoryStore::HistoryStore(std::filesystem::path journal_dir, std::string symbol)
+    : m_dir(std::move(journal_dir)), m_symbol(std::move(symbol))
+{
+    Refresh();
+}
+
+void HistoryStore::Refresh()
+{
+    std::filesystem::path dir = m_dir / m_symbol;
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir, ec)) return;
+
+    // A day may have both a compressed segment and the raw ones of the late records.
+    // The live day is the latest one with the segment not sealed by the writer.
+    std::map<std::chrono::sys_days, uint64_t> days;
+    std::optional<std::chrono::sys_days> live_day;
+    for (const auto& entry: std::filesystem::directory_iterator(dir)) {
+        if (!entry.is_regular_file()) continue;
+        if (!IsRawSegment(entry.path()) && entry.path().extension() != COMPRESSED_EXT) continue;
+
+        auto day = ParseJournalSegmentName(entry.path().stem().string());
+        if (!day) continue;
+
+        bool sealed = true;
+        days[*day] += JournalSourceSize(entry, &sealed);
+        if (entry.path().extension() == JOURNAL_SEGMENT_EXT && !sealed && (!live_day || *day > *live_day))
+            live_day = day;
+    }
+    if (live_day && days.rbegin()->first != *live_day)
+        live_day.reset(); // Left unsealed by a crash, a later day is written already
+
+    for (const auto& [day, source_size]: days) {
+        std::filesystem::path base = dir / JournalSegmentName(day);
+        std::filesystem::path compressed_path = base;
+        compressed_path += COMPRESSED_EXT;
+        std::filesystem::path columns_path = base;
+        columns_path += COLUMNS_EXT;
+
+        auto it = std::lower_bound(m_segments.begin(), m_segments.end(), day, [](const auto& s, std::chrono::sys_days d) { return s->day < d; });
+        bool mapped = it != m_segments.end() && (*it)->day == day;
+
+        try {
+            if (day == live_day) {
+                if (!mapped || !(*it)->live) {
+                    if (mapped) m_segments.erase(it);
+                    auto segment = std::make_unique<Segment>();
+                    segment->day = day;
+                    segment->live = true;
+                    it = std::lower_bound(m_segments.begin(), m_segments.end(), day, [](const auto& s, std::chrono::sys_days d) { return s->day < d; });
+                    it = m_segments.insert(it, std::move(segment));
+                }
+                std::filesystem::path journal_path = base;
+                journal_path += JOURNAL_SEGMENT_EXT;
+                (*it)->AppendLive(journal_path);
+                continue;
+            }
+            if (mapped && (*it)->live) {
+                // The day has been sealed, its columns go to the file now
+                m_segments.erase(it);
+                mapped = false;
+            }
+
+            // The column file is up to date if it is built from the same segment size
+            bool up_to_date = false;
+            if (std::ifstream columns(columns_path, std::ios::binary); columns) {
+                HistoryHeader header {};
+                columns.read(reinterpret_cast<char*>(&header), sizeof(header));
+                up_to_date = columns && std::memcmp(header.magic, HistoryHeader::MAGIC, sizeof(header.magic)) == 0 &&
+                             header.version == HistoryHeader::VERSION && header.source_size == source_size;
+            }
+            if (up_to_date && mapped) continue;
+
+            if (!up_to_date) {
+                if (mapped) {
+                    m_segments.erase(it); // Unmap before the file is replaced
+                    mapped = false;
+                }
+                Build(base, compressed_path, columns_path, source_size);
+            }
+
+            auto segment = Map(day, columns_path);
+            it = std::lower_bound(m_segments.begin(), m_segments.end(), day, [](const auto& s, std::chrono::sys_days d) { return s->day < d; });
+            m_segments.insert(it, std::move(segment));
+        }
+        catch (std::exception& e) {
+            std::cerr << "History segment " << base << " is skipped: " << e.what() << std::endl;
+        }
+    }
+}
+
+size_t HistoryStore::Size() const
+{
+    size_t size = 0;
+    for (const auto& segment: m_segments)
+        size += segment->columns.size();
+    return size;
+}
+
+std::optional<time> HistoryStore::Begin() const
+{
+    for (const auto& segment: m_segments)
+        if (segment->columns.size()) return FromJournalTimeNs(segment->columns.time_ns.front());
+    return {};
+}
+
+std::optional<time> HistoryStore::End() const
+{
+    for (auto it = m_segments.rbegin(); it != m_segments.rend(); ++it)
+        if ((*it)->columns.size()) return FromJournalTimeNs((*it)->columns.time_ns.back());
+    return {};
+}
+
+void HistoryStore::Build(const std::filesystem::path& base, const std::filesystem::path& compressed_path,
+                         const std::filesystem::path& columns_path, uint64_t source_size)
+{
+    std::vector<JournalRecord> trades;
+    if (std::filesystem::exists(compressed_path)) {
+        CompressedSegmentReader(compressed_path).DecodeAll(trades);
+        std::erase_if(trades, [](const JournalRecord& record) { return record.type != JournalRecordType::TRADE; });
+    }
+
+    for (const char* ext: RAW_EXTS) {
+        std::filesystem::path journal_path = base;
+        journal_path += ext;
+
+        std::error_code ec;
+        uint64_t journal_size = std::filesystem::file_size(journal_path, ec);
+        if (ec || journal_size <= sizeof(JournalHeader)) continue;
+
+        boost::interprocess::file_mapping file(journal_path.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only, 0, journal_size);
+
+        for (const auto& record: CommittedRecords(region.get_address(), region.get_size()))
+            if (record.type == JournalRecordType::TRADE) trades.push_back(record);
+    }
+
+    // Trades of a segment come in order normally, but may be a bit out of order after a resubscription
+    std::stable_sort(trades.begin(), trades.end(), [](const JournalRecord& a, const JournalRecord& b) { return a.time_ns < b.time_ns; });
+
+    std::vector<int64_t> time_ns;
+    std::vector<uint64_t> price_points;
+    std::vector<uint64_t> volume_points;
+    std::vector<TradeSide> side;
+    std::vector<HistoryIndexEntry> index;
+    time_ns.reserve(trades.size());
+    price_points.reserve(trades.size());
+    volume_points.reserve(trades.size());
+    side.reserve(Padded(trades.size()));
+    for (const auto& trade: trades) {
+        if (time_ns.size() % INDEX_STRIDE == 0)
+            index.push_back({trade.time_ns, time_ns.size()});
+        time_ns.push_back(trade.time_ns);
+        price_points.push_back(trade.price_points);
+        volume_points.push_back(trade.volume_points);
+        side.push_back(trade.side);
+    }
+    side.resize(Padded(side.size()), TradeSide::BUY);
+
+    HistoryHeader header {};
+    std::memcpy(header.magic, HistoryHeader::MAGIC, sizeof(header.magic));
+    header.version = HistoryHeader::VERSION;
+    header.index_stride = INDEX_STRIDE;
+    header.source_size = source_size;
+    header.rows = trades.size();
+    header.index_size = index.size();
+
+    // Written aside and renamed, so a reader never maps a half written file
+    std::filesystem::path temp_path = columns_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        WriteColumn(file, time_ns);
+        WriteColumn(file, price_points);
+        WriteColumn(file, volume_points);
+        WriteColumn(file, side);
+        WriteColumn(file, index);
+        if (!file.flush()) throw std::runtime_error("Failed to write " + temp_path.string());
+    }
+    std::filesystem::rename(temp_path, columns_path);
+}
+
+std::unique_ptr<HistoryStore::Segment> HistoryStore::Map(std::chrono::sys_days day, const std::filesystem::path& columns_path)
+{
+    auto segment = std::make_unique<Segment>();
+    segment->day = day;
+    segment->file = boost::interprocess::file_mapping(columns_path.c_str(), boost::interprocess::read_only);
+    segment->region = boost::interprocess::mapped_region(segment->file, boost::interprocess::read_only);
+
+    const auto* base = static_cast<const char*>(segment->region.get_address());
+    size_t region_size = segment->region.get_size();
+    if (region_size < sizeof(HistoryHeader)) throw std::runtime_error("Truncated history column file");
+
+    const auto* header = reinterpret_cast<const HistoryHeader*>(base);
+    if (std::memcmp(header->magic, HistoryHeader::MAGIC, sizeof(header->magic)) != 0 || header->version != HistoryHeader::VERSION ||
+        header->index_stride == 0)
+        throw std::runtime_error("Wrong history column file header");
+
+    // The counts are checked against the file size first, so the size calculation below cannot overflow
+    size_t available = region_size - sizeof(HistoryHeader);
+    constexpr size_t ROW_SIZE = sizeof(int64_t) + 2 * sizeof(uint64_t) + sizeof(TradeSide);
+    if (header->rows > available / ROW_SIZE || header->index_size > available / sizeof(HistoryIndexEntry))
+        throw std::runtime_error("Truncated history column file");
+
+    size_t rows = header->rows;
+    size_t size = sizeof(HistoryHeader) + rows * (sizeof(int64_t) + 2 * sizeof(uint64_t)) + Padded(rows) + header->index_size * sizeof(HistoryIndexEntry);
+    if (region_size < size) throw std::runtime_error("Truncated history column file");
+
+    const char* ptr = base + sizeof(HistoryHeader);
+    segment->columns.time_ns = {reinterpret_cast<const int64_t*>(ptr), rows};
+    ptr += rows * sizeof(int64_t);
+    segment->columns.price_points = {reinterpret_cast<const uint64_t*>(ptr), rows};
+    ptr += rows * sizeof(uint64_t);
+    segment->columns.volume_points = {reinterpret_cast<const uint64_t*>(ptr), rows};
+    ptr += rows * sizeof(uint64_t);
+    segment->columns.side = {reinterpret_cast<const TradeSide*>(ptr), rows};
+    ptr += Padded(rows);
+    segment->index = {reinterpret_cast<const HistoryIndexEntry*>(ptr), header->index_size};
+
+    // LowerBound() takes the index rows as column offsets
+    for (size_t i = 0; i < segment->index.size(); ++i)
+        if (segment->index[i].row >= rows || (i && segment->index[i].row <= segment->index[i - 1].row))
+            throw std::runtime_error("Wrong history column file index");
+
+    // Range scans read the columns sequentially
+    segment->region.advise(boost::interprocess::mapped_region::advice_sequential);
+    return segment;
+}
+
+}
@@ -0,0 +1,146 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef HISTORY_STORE_HPP
+#define HISTORY_STORE_HPP
+
+#include "journal.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace scratcher {
+
+// Trades of a time range as parallel columns, i-th elements of the spans make a trade
+struct TradeColumns
+{
+    std::span<const int64_t> time_ns;
+    std::span<const uint64_t> price_points;
+    std::span<const uint64_t> volume_points;
+    std::span<const TradeSide> side;
+
+    size_t size() const
+    { return time_ns.size(); }
+
+    TradeColumns subspan(size_t offset, size_t count) const
+    { return {time_ns.subspan(offset, count), price_points.subspan(offset, count), volume_points.subspan(offset, count), side.subspan(offset, count)}; }
+};
+
+// Column file built next to a journal segment: <YYYY-MM-DD>.cols
+// Layout: header, int64 time[rows], uint64 price[rows], uint64 volume[rows], uint8 side[rows] padded to 8 bytes,
+// then the sparse index of every INDEX_STRIDE-th row
+struct HistoryHeader
+{
+    static constexpr char MAGIC[8] = "SCRCOLS";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t index_stride;
+    uint64_t source_size;   // Size of the journal segments the columns are built from
+    uint64_t rows;
+    uint64_t index_size;
+    uint8_t reserved[24];
+};
+static_assert(sizeof(HistoryHeader) == 64);
+
+struct HistoryIndexEntry
+{
+    int64_t time_ns;
+    uint64_t row;
+};
+
+// Read side of the tick journal for charting and backtests.
+// Trades of every journal segment are kept in a memory-mapped column file sorted by time, so a range is served
+// as spans right over the mapped pages with no deserialization.
+// Seek to a time goes through the sparse index first, so the binary search touches a few cache lines of the columns.
+// Column files are built on Refresh() for the sealed days, when a day is new or has grown since (i.e. by late records),
+// from the compressed segment and the raw ones of the day whichever exist.
+// The live day is not built into a file: its trades are appended in memory from the journal segment, so a refresh
+// costs the records written since the previous one. The store is not thread-safe.
+class HistoryStore
+{
+public:
+    static constexpr uint32_t INDEX_STRIDE = 1024;
+
+private:
+    struct Segment
+    {
+        std::chrono::sys_days day;
+        boost::interprocess::file_mapping file;
+        boost::interprocess::mapped_region region;
+
+        TradeColumns columns;
+        std::span<const HistoryIndexEntry> index;
+
+        // Columns of the live day, the spans above point here
+        bool live = false;
+        uint64_t live_position = 0; // Journal segment records read so far
+        std::vector<int64_t> live_time_ns;
+        std::vector<uint64_t> live_price_points;
+        std::vector<uint64_t> live_volume_points;
+        std::vector<TradeSide> live_side;
+        std::vector<HistoryIndexEntry> live_index;
+
+        // First row with time not less than the given one
+        size_t LowerBound(int64_t time_ns) const;
+        // Appends the trades committed to the journal segment since the previous call
+        void AppendLive(const std::filesystem::path& journal_path);
+    };
+
+    const std::filesystem::path m_dir;
+    const std::string m_symbol;
+    std::vector<std::unique_ptr<Segment>> m_segments; // Sorted by day
+
+    // The raw segments are the base path with the journal extensions
+    static void Build(const std::filesystem::path& base, const std::filesystem::path& compressed_path,
+                      const std::filesystem::path& columns_path, uint64_t source_size);
+    static std::unique_ptr<Segment> Map(std::chrono::sys_days day, const std::filesystem::path& columns_path);
+
+public:
+    // The journal directory is the one passed to TickJournal, trades of the symbol subdirectory are loaded
+    HistoryStore(std::filesystem::path journal_dir, std::string symbol);
+
+    // Picks up the segments written since the last call
+    void Refresh();
+
+    size_t Size() const;
+    std::optional<time> Begin() const;
+    std::optional<time> End() const;
+
+    // Calls handler(const TradeColumns&) for the trades of [from, to), once per segment
+    template <typename F>
+    size_t Scan(time from, time to, F&& handler) const
+    {
+        int64_t from_ns = JournalTimeNs(from);
+        int64_t to_ns = JournalTimeNs(to);
+        size_t count = 0;
+        for (const auto& segment: m_segments) {
+            if (segment->columns.size() == 0) continue;
+            if (segment->columns.time_ns.back() < from_ns) continue;
+            if (segment->columns.time_ns.front() >= to_ns) break;
+
+            size_t begin = segment->LowerBound(from_ns);
+            size_t end = segment->LowerBound(to_ns);
+            if (begin < end) {
+                handler(segment->columns.subspan(begin, end - begin));
+                count += end - begin;
+            }
+        }
+        return count;
+    }
+};
+
+}
+
+#endif //HISTORY_STORE_HPP
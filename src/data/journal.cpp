@@ -0,0 +1,389 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "journal.hpp"
+#include "tick_codec.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace scratcher {
+
+namespace {
+
+std::chrono::sys_days DayOf(const JournalRecord& record)
+{ return std::chrono::floor<std::chrono::days>(std::chrono::sys_time<std::chrono::nanoseconds>(std::chrono::nanoseconds(record.time_ns))); }
+
+void InitHeader(JournalHeader& header, const std::string& symbol)
+{
+    std::memcpy(header.magic, JournalHeader::MAGIC, sizeof(header.magic));
+    header.version = JournalHeader::VERSION;
+    header.record_size = sizeof(JournalRecord);
+    std::strncpy(header.symbol, symbol.c_str(), sizeof(header.symbol));
+}
+
+std::filesystem::path SegmentPath(const std::filesystem::path& dir, std::chrono::sys_days day, const char* ext)
+{ return dir / (JournalSegmentName(day) + ext); }
+
+}
+
+std::string JournalSegmentName(std::chrono::sys_days day)
+{
+    std::chrono::year_month_day date(day);
+    std::ostringstream name;
+    name << static_cast<int>(date.year()) << '-'
+         << std::setw(2) << std::setfill('0') << static_cast<unsigned>(date.month()) << '-'
+         << std::setw(2) << std::setfill('0') << static_cast<unsigned>(date.day());
+    return name.str();
+}
+
+std::optional<std::chrono::sys_days> ParseJournalSegmentName(const std::string& name)
+{
+    int year;
+    unsigned month, day;
+    if (std::sscanf(name.c_str(), "%d-%u-%u", &year, &month, &day) != 3) return {};
+    std::chrono::year_month_day date {std::chrono::year(year), std::chrono::month(month), std::chrono::day(day)};
+    if (!date.ok()) return {};
+    return std::chrono::sys_days(date);
+}
+
+std::span<const JournalRecord> CommittedRecords(const void* segment, size_t size)
+{
+    const auto* header = static_cast<const JournalHeader*>(segment);
+    if (size < sizeof(JournalHeader) || std::memcmp(header->magic, JournalHeader::MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != JournalHeader::VERSION || header->record_size != sizeof(JournalRecord))
+        throw std::runtime_error("Wrong journal segment header");
+
+    uint64_t count = std::min<uint64_t>(header->committed.load(std::memory_order_acquire), (size - sizeof(JournalHeader)) / sizeof(JournalRecord));
+    return {reinterpret_cast<const JournalRecord*>(header + 1), count};
+}
+
+TickJournal::TickJournal(std::filesystem::path dir, bool compress, std::chrono::milliseconds flush_interval)
+    : m_dir(std::move(dir)), m_flush_interval(flush_interval), m_compress(compress)
+{
+    std::filesystem::create_directories(m_dir);
+    m_writer = std::thread([this] { Run(); });
+}
+
+TickJournal::~TickJournal()
+{
+    {
+        std::unique_lock lock(m_mutex);
+        m_stop = true;
+    }
+    m_stop_signal.notify_one();
+    m_writer.join();
+    m_compressions.clear(); // Waits for the futures
+}
+
+void TickJournal::Record(std::string symbol, std::shared_ptr<DataProvider> provider)
+{
+    auto source = std::make_unique<Source>();
+    source->symbol = std::move(symbol);
+    source->live_day = std::chrono::floor<std::chrono::days>(std::chrono::system_clock::now());
+
+    // Past days left by a previous run: its rollover compression could not happen if it was stopped within a minute,
+    // or was down over the midnight
+    std::error_code ec;
+    if (m_compress) {
+        for (const auto& entry: std::filesystem::directory_iterator(m_dir / source->symbol, ec)) {
+            auto ext = entry.path().extension();
+            if (!entry.is_regular_file() || (ext != JOURNAL_SEGMENT_EXT && ext != JOURNAL_LATE_EXT && ext != JOURNAL_MERGE_EXT)) continue;
+            if (auto day = ParseJournalSegmentName(entry.path().stem().string()); day && *day < source->live_day)
+                ScheduleCompress(*source, *day, {});
+        }
+    }
+
+    source->provider = std::move(provider);
+    source->trades = source->provider->Subscribe<Trade>("journal", ConsumerPolicy::LOSSLESS, QUEUE_SIZE);
+    source->book = source->provider->Subscribe<OrderBookUpdate>("journal", ConsumerPolicy::LOSSLESS, QUEUE_SIZE, {}, true);
+
+    std::unique_lock lock(m_mutex);
+    m_sources.emplace_back(std::move(source));
+}
+
+JournalStats TickJournal::Stats() const
+{
+    return {m_records.load(std::memory_order_relaxed), m_bytes.load(std::memory_order_relaxed),
+            m_batches.load(std::memory_order_relaxed), m_gaps.load(std::memory_order_relaxed),
+            m_errors.load(std::memory_order_relaxed), m_compressed.load(std::memory_order_relaxed)};
+}
+
+void TickJournal::Run()
+{
+    std::unique_lock lock(m_mutex);
+    bool stop = false;
+    while (!stop) {
+        // The last round after the stop request writes out what is left in the queues
+        stop = m_stop_signal.wait_for(lock, m_flush_interval, [this] { return m_stop; });
+        for (auto& source: m_sources) {
+            Collect(*source, stop);
+            Write(*source);
+            if (m_compress) Compress(*source);
+        }
+    }
+    for (auto& source: m_sources)
+        CloseSegment(*source);
+}
+
+void TickJournal::Collect(Source& source, bool last)
+{
+    // Both queues are pushed on the provider strand, so the enqueue times give the order of publishing
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    // Everything enqueued up to the cutoff is drained from both queues, later events wait for the next round.
+    // The last round takes all, nothing is published after the stop
+    time_point cutoff = last ? time_point::max() : std::chrono::steady_clock::now();
+
+    source.trades->Drain([&source](const Trade& trade, time_point enqueued) {
+        source.trade_records.emplace_back(enqueued, JournalRecord{JournalTimeNs(trade.trade_time), trade.price_points, trade.volume_points, JournalRecordType::TRADE, trade.side, {}});
+    });
+
+    source.book->Drain([&source](const OrderBookUpdate& update, time_point enqueued) {
+        int64_t received = JournalTimeNs(update.received);
+        source.book_records.push_back({received, update.update_id, update.bids.size() + update.asks.size(),
+                                       update.snapshot ? JournalRecordType::BOOK_SNAPSHOT : JournalRecordType::BOOK_DELTA, TradeSide::BUY, {}});
+        for (const auto& level: update.bids)
+            source.book_records.push_back({received, level.price_points, level.volume_points, JournalRecordType::BID, TradeSide::BUY, {}});
+        for (const auto& level: update.asks)
+            source.book_records.push_back({received, level.price_points, level.volume_points, JournalRecordType::ASK, TradeSide::SELL, {}});
+        source.book_updates.emplace_back(enqueued, source.book_records.size());
+    });
+
+    // Book updates are kept whole: the header is followed by its levels
+    auto trade = source.trade_records.begin();
+    auto update = source.book_updates.begin();
+    size_t book_begin = 0;
+    for (; update != source.book_updates.end() && update->first <= cutoff; ++update) {
+        for (; trade != source.trade_records.end() && trade->first <= update->first; ++trade)
+            source.batch.push_back(trade->second);
+        source.batch.insert(source.batch.end(), source.book_records.begin() + book_begin, source.book_records.begin() + update->second);
+        book_begin = update->second;
+    }
+    for (; trade != source.trade_records.end() && trade->first <= cutoff; ++trade)
+        source.batch.push_back(trade->second);
+
+    source.trade_records.erase(source.trade_records.begin(), trade);
+    source.book_updates.erase(source.book_updates.begin(), update);
+    source.book_records.erase(source.book_records.begin(), source.book_records.begin() + book_begin);
+    for (auto& carried: source.book_updates)
+        carried.second -= book_begin;
+
+    int64_t now = JournalTimeNs(std::chrono::utc_clock::now());
+
+    // The provider has already dropped an overflowed or disconnected queue, so a fresh one is needed
+    if (source.trades->Overflowed()) {
+        std::cerr << "Journal " << source.symbol << " trade queue overflow or reset" << std::endl;
+        source.batch.push_back({now, 0, 0, JournalRecordType::GAP, TradeSide::BUY, {}});
+        source.trades = source.provider->Subscribe<Trade>("journal", ConsumerPolicy::LOSSLESS, QUEUE_SIZE);
+        m_gaps.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (source.book->Overflowed()) {
+        std::cerr << "Journal " << source.symbol << " order book queue overflow or reset" << std::endl;
+        source.batch.push_back({now, 0, 0, JournalRecordType::GAP, TradeSide::BUY, {}});
+        source.book = source.provider->Subscribe<OrderBookUpdate>("journal", ConsumerPolicy::LOSSLESS, QUEUE_SIZE, {}, true);
+        m_gaps.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void TickJournal::Write(Source& source)
+{
+    if (source.batch.empty()) return;
+
+    try {
+        // A batch may run over midnight, so it is split into the runs of the same day
+        for (auto it = source.batch.begin(); it != source.batch.end(); ) {
+            auto day = DayOf(*it);
+            auto run_end = std::find_if(it, source.batch.end(), [day](const JournalRecord& record) { return DayOf(record) != day; });
+            uint64_t count = run_end - it;
+
+            if (day < source.live_day) {
+                WriteLate(source, day, {&*it, count});
+                it = run_end;
+                continue;
+            }
+
+            if (!source.segment_header || source.segment_day != day)
+                OpenSegment(source, day);
+
+            uint64_t committed = source.segment_header->committed.load(std::memory_order_relaxed);
+            if (committed + count > source.segment_capacity)
+                GrowSegment(source, committed + count);
+
+            std::memcpy(reinterpret_cast<JournalRecord*>(source.segment_header + 1) + committed, &*it, count * sizeof(JournalRecord));
+            source.segment_header->committed.store(committed + count, std::memory_order_release);
+
+            m_records.fetch_add(count, std::memory_order_relaxed);
+            m_bytes.fetch_add(count * sizeof(JournalRecord), std::memory_order_relaxed);
+            it = run_end;
+        }
+    }
+    catch (std::exception& e) {
+        std::cerr << "Journal " << source.symbol << " write failed: " << e.what() << std::endl;
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        CloseSegment(source); // Reopened with the next batch
+    }
+    m_batches.fetch_add(1, std::memory_order_relaxed);
+    source.batch.clear();
+}
+
+void TickJournal::WriteLate(Source& source, std::chrono::sys_days day, std::span<const JournalRecord> records)
+{
+    // Late records are rare, so the segment is mapped for the write only
+    std::filesystem::path dir = m_dir / source.symbol;
+    std::filesystem::create_directories(dir);
+    std::filesystem::path path = SegmentPath(dir, day, JOURNAL_LATE_EXT);
+
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    bool fresh = ec || size < sizeof(JournalHeader);
+    if (fresh) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc);
+        size = sizeof(JournalHeader);
+    }
+    std::filesystem::resize_file(path, size + records.size() * sizeof(JournalRecord));
+
+    boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_write);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_write);
+    auto* header = static_cast<JournalHeader*>(region.get_address());
+    if (fresh) {
+        InitHeader(*header, source.symbol);
+        header->sealed.store(1, std::memory_order_relaxed);
+    }
+
+    uint64_t committed = CommittedRecords(header, size).size();
+    std::memcpy(reinterpret_cast<JournalRecord*>(header + 1) + committed, records.data(), records.size_bytes());
+    header->committed.store(committed + records.size(), std::memory_order_release);
+
+    m_records.fetch_add(records.size(), std::memory_order_relaxed);
+    m_bytes.fetch_add(records.size_bytes(), std::memory_order_relaxed);
+
+    if (m_compress) ScheduleCompress(source, day, COMPRESS_DELAY);
+}
+
+void TickJournal::ScheduleCompress(Source& source, std::chrono::sys_days day, std::chrono::steady_clock::duration delay)
+{ source.compress_due.try_emplace(day, std::chrono::steady_clock::now() + delay); }
+
+void TickJournal::Compress(Source& source)
+{
+    std::erase_if(m_compressions, [](const auto& f) { return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+
+    auto now = std::chrono::steady_clock::now();
+    std::filesystem::path dir = m_dir / source.symbol;
+    for (auto it = source.compress_due.begin(); it != source.compress_due.end(); ) {
+        if (it->second > now) {
+            ++it;
+            continue;
+        }
+        std::chrono::sys_days day = it->first;
+        it = source.compress_due.erase(it);
+
+        // The late segment is taken aside here on the writer thread, so no record is appended after the compression
+        // has read it: the next late records start a new late segment compressed with the next round
+        std::filesystem::path merge_path = SegmentPath(dir, day, JOURNAL_MERGE_EXT);
+        std::filesystem::path late_path = SegmentPath(dir, day, JOURNAL_LATE_EXT);
+        std::error_code ec;
+        if (!std::filesystem::exists(merge_path, ec))
+            std::filesystem::rename(late_path, merge_path, ec);
+        else if (std::filesystem::exists(late_path, ec))
+            ScheduleCompress(source, day, COMPRESS_DELAY); // Left by a failed run, the late segment waits for the next round
+
+        // Conversion of a day long segment takes a while, so it does not hold the writer
+        m_compressions.emplace_back(std::async(std::launch::async, [this, dir, day] {
+            std::unique_lock lock(m_compress_mutex);
+            std::filesystem::path compressed_path = SegmentPath(dir, day, ".tickz");
+            for (const char* ext: {JOURNAL_SEGMENT_EXT, JOURNAL_MERGE_EXT}) {
+                std::filesystem::path path = SegmentPath(dir, day, ext);
+                try {
+                    if (!std::filesystem::exists(path)) continue;
+                    CompressSegment(path, compressed_path);
+                    std::filesystem::remove(path);
+                    m_compressed.fetch_add(1, std::memory_order_relaxed);
+                }
+                catch (std::exception& e) {
+                    std::cerr << "Journal segment " << path << " compression failed: " << e.what() << std::endl;
+                    m_errors.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }));
+    }
+}
+
+void TickJournal::OpenSegment(Source& source, std::chrono::sys_days day)
+{
+    if (source.segment_header && day > source.segment_day && m_compress)
+        ScheduleCompress(source, source.segment_day, COMPRESS_DELAY);
+    source.live_day = std::max(source.live_day, day);
+    CloseSegment(source);
+
+    std::filesystem::path dir = m_dir / source.symbol;
+    std::filesystem::create_directories(dir);
+
+    source.segment_day = day;
+    source.segment_path = SegmentPath(dir, day, JOURNAL_SEGMENT_EXT);
+
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(source.segment_path, ec);
+    bool fresh = ec || size < sizeof(JournalHeader);
+    if (fresh) {
+        std::ofstream(source.segment_path, std::ios::binary | std::ios::trunc);
+        std::filesystem::resize_file(source.segment_path, sizeof(JournalHeader) + SEGMENT_GROWTH * sizeof(JournalRecord));
+    }
+
+    MapSegment(source);
+
+    JournalHeader* header = source.segment_header;
+    if (fresh)
+        InitHeader(*header, source.symbol);
+    else {
+        // A restart within the day
+        CommittedRecords(header, source.segment_region.get_size());
+        header->sealed.store(0, std::memory_order_release);
+    }
+}
+
+void TickJournal::MapSegment(Source& source)
+{
+    source.segment_file = boost::interprocess::file_mapping(source.segment_path.c_str(), boost::interprocess::read_write);
+    source.segment_region = boost::interprocess::mapped_region(source.segment_file, boost::interprocess::read_write);
+    source.segment_header = static_cast<JournalHeader*>(source.segment_region.get_address());
+    source.segment_capacity = (source.segment_region.get_size() - sizeof(JournalHeader)) / sizeof(JournalRecord);
+}
+
+void TickJournal::GrowSegment(Source& source, uint64_t records)
+{
+    uint64_t capacity = std::max(records, source.segment_capacity + SEGMENT_GROWTH);
+
+    source.segment_region = {};
+    source.segment_header = nullptr;
+    std::filesystem::resize_file(source.segment_path, sizeof(JournalHeader) + capacity * sizeof(JournalRecord));
+    MapSegment(source);
+}
+
+void TickJournal::CloseSegment(Source& source)
+{
+    if (!source.segment_header) return;
+
+    uint64_t committed = source.segment_header->committed.load(std::memory_order_relaxed);
+    source.segment_header->sealed.store(1, std::memory_order_release);
+
+    source.segment_region = {};
+    source.segment_file = {};
+    source.segment_header = nullptr;
+    source.segment_capacity = 0;
+
+    // Readers never look past the committed records, so the preallocated tail can go
+    std::error_code ec;
+    std::filesystem::resize_file(source.segment_path, sizeof(JournalHeader) + committed * sizeof(JournalRecord), ec);
+    if (ec) std::cerr << "Journal segment " << source.segment_path << " trim failed: " << ec.message() << std::endl;
+}
+
+}
@@ -0,0 +1,188 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include "data_provider.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace scratcher {
+
+enum class JournalRecordType: uint8_t {
+    TRADE = 1,
+    BOOK_SNAPSHOT,  // Header of a full book, followed by BID/ASK level records
+    BOOK_DELTA,     // Header of changed levels, followed by BID/ASK level records
+    BID,
+    ASK,
+    GAP             // Events lost on the journal queue overflow, the book is consistent again from the next snapshot
+};
+
+// Fixed layout record in host (little-endian) byte order
+struct JournalRecord
+{
+    int64_t time_ns;        // Unix time: trade time, or local time the book update was received
+    uint64_t price_points;  // Book update id for BOOK_SNAPSHOT/BOOK_DELTA
+    uint64_t volume_points; // Number of the level records following BOOK_SNAPSHOT/BOOK_DELTA, 0 for a removed level
+    JournalRecordType type;
+    TradeSide side;
+    uint8_t reserved[6];
+};
+static_assert(sizeof(JournalRecord) == 32);
+
+// Segment file starts with the header followed by records.
+// The writer maps the segment and shares the header with the readers: records are copied in place first
+// and then published by the committed counter, so a reader in another process sees complete records only.
+// The file is preallocated ahead of the committed records and trimmed when the segment is sealed.
+struct JournalHeader
+{
+    static constexpr char MAGIC[8] = "SCRTICK";
+    static constexpr uint32_t VERSION = 2;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    char symbol[16];
+    std::atomic<uint64_t> committed;    // Number of the records written in full
+    std::atomic<uint32_t> sealed;       // The writer has moved to the next day segment
+    uint8_t reserved[20];
+};
+static_assert(sizeof(JournalHeader) == 64);
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "The header atomics are shared between processes");
+
+// Committed records of a mapped segment, throws if the header is wrong
+std::span<const JournalRecord> CommittedRecords(const void* segment, size_t size);
+
+inline int64_t JournalTimeNs(time t)
+{ return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::utc_clock::to_sys(t).time_since_epoch()).count(); }
+
+// Segment file name of the UTC day without extension: YYYY-MM-DD
+std::string JournalSegmentName(std::chrono::sys_days day);
+
+// Segment of the live day, late records of the past days, and the late records taken by a running compression
+constexpr const char* JOURNAL_SEGMENT_EXT = ".tick";
+constexpr const char* JOURNAL_LATE_EXT = ".late";
+constexpr const char* JOURNAL_MERGE_EXT = ".merge";
+std::optional<std::chrono::sys_days> ParseJournalSegmentName(const std::string& name);
+
+struct JournalStats
+{
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t batches;
+    uint64_t gaps;
+    uint64_t errors;
+    uint64_t compressed;    // Segments compressed after the day has passed
+};
+
+// Append-only journal of normalized trades and order book updates.
+// Every symbol is written to <dir>/<symbol>/<YYYY-MM-DD>.tick segments, one per UTC day.
+// The journal is a LOSSLESS consumer of the data providers, so the only cost on the provider strand is a queue push.
+// A dedicated writer thread collects the queues and appends them to the mapped segment every flush interval,
+// other processes may follow the segments live with JournalTail.
+// Records are written in the order the provider has published the events, trades interleaved with book updates.
+// A past day segment is never reopened: records older than the live day go to <YYYY-MM-DD>.late, which has the same
+// layout. With compression on, a segment is converted to <YYYY-MM-DD>.tickz in the background once its day has passed,
+// and the late records are merged into it the same way. Past days left uncompressed by a previous run are picked up
+// when the symbol recording starts.
+class TickJournal
+{
+public:
+    static constexpr size_t QUEUE_SIZE = 65536;
+    static constexpr std::chrono::milliseconds DEFAULT_FLUSH_INTERVAL {100};
+    static constexpr std::chrono::minutes COMPRESS_DELAY {1};
+    static constexpr uint64_t SEGMENT_GROWTH = 1 << 20; // Records to preallocate at once
+
+private:
+    struct Source
+    {
+        std::string symbol;
+        std::shared_ptr<DataProvider> provider;
+        std::shared_ptr<EventQueue<Trade>> trades;
+        std::shared_ptr<EventQueue<OrderBookUpdate>> book;
+
+        std::vector<JournalRecord> batch;
+        // Drained events, merged into the batch in the order of publishing. The ones enqueued after the collect
+        // started are carried over to the next batch, the other queue may not have been drained up to them yet
+        std::vector<std::pair<std::chrono::steady_clock::time_point, JournalRecord>> trade_records;
+        std::vector<JournalRecord> book_records;
+        std::vector<std::pair<std::chrono::steady_clock::time_point, size_t>> book_updates; // Enqueue time, end of its records
+        std::chrono::sys_days segment_day {};
+        std::filesystem::path segment_path;
+        boost::interprocess::file_mapping segment_file;
+        boost::interprocess::mapped_region segment_region;
+        JournalHeader* segment_header = nullptr;
+        uint64_t segment_capacity = 0;  // Records
+
+        std::chrono::sys_days live_day {};      // Records of earlier days are late
+        std::map<std::chrono::sys_days, std::chrono::steady_clock::time_point> compress_due; // Past days to compress
+    };
+
+    const std::filesystem::path m_dir;
+    const std::chrono::milliseconds m_flush_interval;
+    const bool m_compress;
+
+    std::mutex m_mutex;
+    std::condition_variable m_stop_signal;
+    bool m_stop = false;
+    std::vector<std::unique_ptr<Source>> m_sources;
+
+    std::atomic<uint64_t> m_records = 0;
+    std::atomic<uint64_t> m_bytes = 0;
+    std::atomic<uint64_t> m_batches = 0;
+    std::atomic<uint64_t> m_gaps = 0;
+    std::atomic<uint64_t> m_errors = 0;
+    std::atomic<uint64_t> m_compressed = 0;
+
+    std::mutex m_compress_mutex; // Compressions of the same day must not overlap
+    std::vector<std::future<void>> m_compressions;
+    std::thread m_writer;
+
+    void Run();
+    void Collect(Source& source, bool last);
+    void Write(Source& source);
+    void WriteLate(Source& source, std::chrono::sys_days day, std::span<const JournalRecord> records);
+    void ScheduleCompress(Source& source, std::chrono::sys_days day, std::chrono::steady_clock::duration delay);
+    void OpenSegment(Source& source, std::chrono::sys_days day);
+    void MapSegment(Source& source);
+    void GrowSegment(Source& source, uint64_t records);
+    void CloseSegment(Source& source);
+    void Compress(Source& source);
+
+public:
+    explicit TickJournal(std::filesystem::path dir, bool compress = false, std::chrono::milliseconds flush_interval = DEFAULT_FLUSH_INTERVAL);
+    // Writes out the collected events and waits for the running compressions before return
+    ~TickJournal();
+
+    TickJournal(const TickJournal&) = delete;
+    TickJournal& operator=(const TickJournal&) = delete;
+
+    // Starts recording of the provider events, the book is recorded starting from a snapshot
+    void Record(std::string symbol, std::shared_ptr<DataProvider> provider);
+
+    JournalStats Stats() const;
+};
+
+}
+
+#endif //JOURNAL_HPP
@@ -0,0 +1,79 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "journal_tail.hpp"
+
+namespace scratcher {
+
+JournalTail::JournalTail(const std::filesystem::path& journal_dir, const std::string& symbol, bool from_end)
+    : m_dir(journal_dir / symbol), m_from_end(from_end)
+{
+    OpenNext();
+}
+
+bool JournalTail::OpenNext()
+{
+    std::error_code ec;
+    if (!std::filesystem::is_directory(m_dir, ec)) return false;
+
+    // The latest segment to start with, the next day one afterwards
+    std::optional<std::chrono::sys_days> next;
+    for (const auto& entry: std::filesystem::directory_iterator(m_dir, ec)) {
+        if (!entry.is_regular_file() || entry.path().extension() != ".tick") continue;
+        auto day = ParseJournalSegmentName(entry.path().stem().string());
+        if (!day) continue;
+
+        if (m_day) {
+            if (*day > *m_day && (!next || *day < *next)) next = day;
+        }
+        else if (!next || *day > *next)
+            next = day;
+    }
+    if (!next) return false;
+
+    std::filesystem::path path = m_dir / (JournalSegmentName(*next) + ".tick");
+    try {
+        boost::interprocess::file_mapping file(path.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+        auto records = CommittedRecords(region.get_address(), region.get_size());
+
+        bool first = !m_day;
+        m_file = std::move(file);
+        m_region = std::move(region);
+        m_header = static_cast<const JournalHeader*>(m_region.get_address());
+        m_position = first && m_from_end ? records.size() : 0;
+        m_day = next;
+        return true;
+    }
+    catch (std::exception&) {
+        return false; // The writer has not filled the header in yet, retried with the next poll
+    }
+}
+
+std::span<const JournalRecord> JournalTail::Poll()
+{
+    if (!m_header && !OpenNext()) return {};
+
+    // Sealed is read first, so the committed counter read after it is final if the segment is sealed
+    bool sealed = m_header->sealed.load(std::memory_order_acquire);
+    uint64_t committed = m_header->committed.load(std::memory_order_acquire);
+
+    if (committed == m_position) {
+        if (sealed && OpenNext()) return Poll();
+        return {};
+    }
+
+    if (sizeof(JournalHeader) + committed * sizeof(JournalRecord) > m_region.get_size()) {
+        m_region = boost::interprocess::mapped_region(m_file, boost::interprocess::read_only);
+        m_header = static_cast<const JournalHeader*>(m_region.get_address());
+    }
+
+    std::span<const JournalRecord> records(reinterpret_cast<const JournalRecord*>(m_header + 1) + m_position, committed - m_position);
+    m_position = committed;
+    return records;
+}
+
+}
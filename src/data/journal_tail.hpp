@@ -0,0 +1,53 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef JOURNAL_TAIL_HPP
+#define JOURNAL_TAIL_HPP
+
+#include "journal.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace scratcher {
+
+// Follows the journal of a symbol written by TickJournal, normally from another process.
+// The segment is mapped read-only and the records are served right from the shared pages: Poll() reads the
+// committed counter of the segment header and does no syscalls unless the writer has grown the file over
+// the mapped size or has moved to the next day segment.
+// Late records added to a segment after it is sealed are not seen by a tail which has moved on already.
+class JournalTail
+{
+    const std::filesystem::path m_dir;
+    const bool m_from_end;
+
+    std::optional<std::chrono::sys_days> m_day;
+    boost::interprocess::file_mapping m_file;
+    boost::interprocess::mapped_region m_region;
+    const JournalHeader* m_header = nullptr;
+    uint64_t m_position = 0;
+
+    bool OpenNext();
+
+public:
+    // Starts from the latest segment, skipping the records it already has if from_end is set
+    JournalTail(const std::filesystem::path& journal_dir, const std::string& symbol, bool from_end = true);
+
+    // Records committed since the previous call, valid until the next call
+    std::span<const JournalRecord> Poll();
+
+    std::optional<std::chrono::sys_days> Day() const
+    { return m_day; }
+};
+
+}
+
+#endif //JOURNAL_TAIL_HPP
@@ -6,8 +6,16 @@
 
 #include "scheduler.hpp"
 
+#include <algorithm>
+#include <iostream>
+#include <functional>
 #include <ranges>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace scratcher {
 
 namespace {
@@ -37,24 +45,270 @@ char const * xscratcher_error_category_impl::message(int e, char *buffer, std::s
     return buffer;
 }
 
-AsioScheduler::AsioScheduler()
-    : m_io_ctx(), m_ssl_ctx(ssl::context::tlsv12_client)
-    , m_io_guard(make_work_guard(m_io_ctx))
+#ifdef BOOST_ASIO_HAS_IO_URING
+
+std::vector<boost::asio::mutable_buffer> RegisteredBufferPool::Split(std::vector<char>& storage)
+{
+    std::vector<boost::asio::mutable_buffer> buffers;
+    for (size_t i = 0; i < BUFFER_COUNT; ++i)
+        buffers.emplace_back(storage.data() + i * BUFFER_SIZE, BUFFER_SIZE);
+    return buffers;
+}
+
+RegisteredBufferPool::RegisteredBufferPool(io_context& io)
+    : m_storage(BUFFER_SIZE * BUFFER_COUNT)
+    , m_buffers(Split(m_storage))
+    , m_registration(boost::asio::register_buffers(io, m_buffers))
 {
+    for (size_t i = BUFFER_COUNT; i > 0; --i)
+        m_free.push_back(i - 1);
+}
+
+std::optional<size_t> RegisteredBufferPool::Acquire()
+{
+    std::unique_lock lock(m_free_mutex);
+    if (m_free.empty()) return {};
+
+    size_t index = m_free.back();
+    m_free.pop_back();
+    return index;
+}
+
+void RegisteredBufferPool::Release(size_t index)
+{
+    std::unique_lock lock(m_free_mutex);
+    m_free.push_back(index);
+}
+
+#endif
+
+AsioScheduler::Shard::Shard(int concurrency_hint)
+    : io(concurrency_hint)
+    , guard(make_work_guard(io))
+#ifdef BOOST_ASIO_HAS_IO_URING
+    , read_buffers(io)
+#endif
+{
+}
+
+AsioScheduler::AsioScheduler(size_t shards)
+    : m_ssl_ctx(ssl::context::tlsv12_client)
+{
+    if (shards == 0) throw std::invalid_argument("No scheduler shards");
+
+    // A hint of 1 tells the context it is run by a single thread, which only lets the scheduler skip some of
+    // its locking. The reactor and io_uring locks stay: BOOST_ASIO_CONCURRENCY_HINT_UNSAFE_IO would remove them,
+    // but then every socket and timer of a shard must be used from its thread only, while streams are still
+    // closed and destroyed from other threads (e.g. on unsubscribe)
+    int concurrency_hint = shards > 1 ? 1 : BOOST_ASIO_CONCURRENCY_HINT_DEFAULT;
+    for (size_t i = 0; i < shards; ++i)
+        m_shards.emplace_back(std::make_shared<Shard>(concurrency_hint));
+}
+
+const char* AsioScheduler::Backend()
+{
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    return "io_uring";
+#elif defined(BOOST_ASIO_HAS_IO_URING)
+    return "epoll (io_uring for files)";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+    return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+    return "kqueue";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+    return "iocp";
+#else
+    return "select";
+#endif
 }
 
 AsioScheduler::~AsioScheduler()
 {
-    m_io_guard.reset();
+    // The last reference may be released by a handler on one of the scheduler threads. That thread cannot be joined
+    // and is still inside run() of its shard, so the contexts are stopped instead of drained, the other threads are
+    // joined and the current one is detached. It keeps its shard alive until run() returns, see Start().
+    bool on_scheduler_thread = std::ranges::any_of(m_threads, [](const std::thread& t) { return t.get_id() == std::this_thread::get_id(); });
+
+    for (auto& shard: m_shards) {
+        shard->guard.reset();
+        if (on_scheduler_thread) shard->io.stop();
+    }
+    for (auto& t: m_threads) {
+        if (t.get_id() == std::this_thread::get_id())
+            t.detach();
+        else
+            t.join();
+    }
+}
+
+void PinThread(std::thread& thread, int cpu)
+{
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (int res = pthread_setaffinity_np(thread.native_handle(), sizeof(cpuset), &cpuset); res != 0)
+        std::cerr << "Failed to pin thread to CPU " << cpu << ": " << std::system_category().message(res) << std::endl;
+#else
+    std::cerr << "Thread CPU pinning is supported on Linux only" << std::endl;
+#endif
+}
+
+thread_local const ComputePool* ComputePool::s_worker_pool = nullptr;
+thread_local size_t ComputePool::s_worker_index = 0;
+
+ComputePool::ComputePool(size_t threads, const std::vector<int>& cpus)
+{
+    if (threads == 0) throw std::invalid_argument("No compute threads");
+
+    for (size_t i = 0; i < threads; ++i)
+        m_workers.emplace_back(std::make_unique<Worker>());
+
+    for (size_t i = 0; i < threads; ++i) {
+        auto& thread = m_threads.emplace_back([this, i]{ Run(i); });
+        if (i < cpus.size())
+            PinThread(thread, cpus[i]);
+    }
+}
+
+ComputePool::~ComputePool()
+{
+    m_stop = true;
+    for (auto& worker: m_workers) {
+        // Under the worker lock, so the flag is not missed between the check and the wait
+        std::unique_lock lock(worker->mutex);
+        worker->wake.notify_one();
+    }
     for (auto& t: m_threads) t.join();
 }
 
-std::shared_ptr<AsioScheduler> AsioScheduler::Create(size_t threads)
+void ComputePool::Submit(std::function<void()> job)
+{
+    // A job submitted from a worker goes to its own queue, where it is likely to find hot caches
+    size_t index = s_worker_pool == this ? s_worker_index : m_next_worker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+    Worker& worker = *m_workers[index];
+    bool owner_idle;
+    {
+        std::unique_lock lock(worker.mutex);
+        worker.jobs.emplace_back(move(job));
+        ++m_pending;
+        owner_idle = worker.idle;
+        if (owner_idle) worker.wake.notify_one();
+    }
+    // The owner is busy, so another worker may take the job earlier
+    if (!owner_idle && m_idle.load() != 0)
+        WakeIdle(index);
+}
+
+void ComputePool::WakeIdle(size_t except)
+{
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        Worker& worker = *m_workers[(except + i) % m_workers.size()];
+        std::unique_lock lock(worker.mutex);
+        if (worker.idle && !worker.poked) {
+            worker.poked = true;
+            worker.wake.notify_one();
+            return;
+        }
+    }
+}
+
+std::optional<std::function<void()>> ComputePool::Take(size_t index)
+{
+    {
+        Worker& own = *m_workers[index];
+        std::unique_lock lock(own.mutex);
+        if (!own.jobs.empty()) {
+            auto job = move(own.jobs.back());
+            own.jobs.pop_back();
+            --m_pending;
+            return job;
+        }
+    }
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        Worker& victim = *m_workers[(index + i) % m_workers.size()];
+        std::unique_lock lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            auto job = move(victim.jobs.front());
+            victim.jobs.pop_front();
+            --m_pending;
+            return job;
+        }
+    }
+    return {};
+}
+
+void ComputePool::Run(size_t index)
+{
+    s_worker_pool = this;
+    s_worker_index = index;
+    Worker& own = *m_workers[index];
+    while (!m_stop) {
+        if (auto job = Take(index)) {
+            try {
+                (*job)();
+            }
+            catch (std::exception& e) {
+                std::cerr << "Compute job error: " << e.what() << std::endl;
+            }
+            continue;
+        }
+
+        // Jobs pushed to the own queue are never missed: they are checked under the same lock the submit takes.
+        // A job queued to a busy worker while this one is going to park waits for its owner
+        std::unique_lock lock(own.mutex);
+        own.idle = true;
+        ++m_idle;
+        own.wake.wait(lock, [&]{ return m_stop || own.poked || !own.jobs.empty(); });
+        own.idle = false;
+        own.poked = false;
+        --m_idle;
+    }
+}
+
+void AsioScheduler::Start(size_t threads, const std::vector<int>& cpus)
+{
+    for (size_t i: std::ranges::iota_view(0ul, threads)) {
+        // The thread owns its shard too, so the io_context outlives run() even if the thread gets detached
+        auto& thread = m_threads.emplace_back([shard = m_shards[i % m_shards.size()]]{ shard->io.run(); });
+        if (i < cpus.size())
+            PinThread(thread, cpus[i]);
+    }
+}
+
+std::shared_ptr<AsioScheduler> AsioScheduler::Create(size_t threads, const std::vector<int>& cpus)
 {
     auto self = std::make_shared<AsioScheduler>();
-    for (size_t i: std::ranges::iota_view(0ul, threads))
-        self->m_threads.emplace_back([self]{ self->io().run(); });
+    std::clog << "Asio scheduler: " << threads << " threads, " << Backend() << " backend" << std::endl;
+    self->Start(threads, cpus);
+    return self;
+}
 
+std::shared_ptr<AsioScheduler> AsioScheduler::CreatePerCore(size_t threads, const std::vector<int>& cpus)
+{
+    auto self = std::make_shared<AsioScheduler>(threads);
+    std::clog << "Asio scheduler: " << threads << " threads, thread per core, " << Backend() << " backend" << std::endl;
+    self->Start(threads, cpus);
     return self;
 }
+
+void AsioScheduler::StartCompute(size_t threads, const std::vector<int>& cpus)
+{
+    std::call_once(m_compute_once, [&]{
+        std::clog << "Compute pool: " << threads << " threads" << std::endl;
+        m_compute = std::make_unique<ComputePool>(threads, cpus);
+    });
+}
+
+ComputePool& AsioScheduler::compute()
+{
+    StartCompute(1);
+    return *m_compute;
+}
+
+size_t AsioScheduler::ShardFor(std::string_view key) const
+{
+    if (m_shards.size() == 1) return 0;
+    return 1 + std::hash<std::string_view>{}(key) % (m_shards.size() - 1);
+}
 }
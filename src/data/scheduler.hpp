@@ -9,9 +9,20 @@
 
 #include <thread>
 #include <list>
+#include <deque>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 
 namespace scratcher {
 
@@ -38,23 +49,150 @@ inline boost::system::error_code xscratcher_error_code(error e)
 { return boost::system::error_code(static_cast<int>(e), xscratcher_error_category());}
 
 using boost::asio::io_context;
-using boost::asio::yield_context;
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+using boost::asio::redirect_error;
 
 namespace ssl = boost::asio::ssl;
 
+// Pins the thread to the CPU, failures are logged only
+void PinThread(std::thread& thread, int cpu);
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+
+// Fixed size read buffers registered with io_uring once per io_context, so socket reads into them
+// are issued as IORING_OP_READ_FIXED with no per-read page pinning.
+// io_uring allows a single registration per ring, hence one pool is shared by all the streams.
+class RegisteredBufferPool
+{
+public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+    static constexpr size_t BUFFER_COUNT = 16;
+
+private:
+    std::vector<char> m_storage;
+    std::vector<boost::asio::mutable_buffer> m_buffers;
+    boost::asio::buffer_registration<std::vector<boost::asio::mutable_buffer>> m_registration;
+
+    std::mutex m_free_mutex;
+    std::vector<size_t> m_free;
+
+    static std::vector<boost::asio::mutable_buffer> Split(std::vector<char>& storage);
+
+public:
+    explicit RegisteredBufferPool(io_context& io);
+
+    // Returns an index of a free buffer or nothing if the pool is exhausted
+    std::optional<size_t> Acquire();
+    void Release(size_t index);
+
+    const boost::asio::mutable_registered_buffer& operator[](size_t index) const
+    { return m_registration[index]; }
+};
+
+#endif
+
+// Work stealing thread pool for CPU bound jobs (analytics, indicators) kept off the I/O threads.
+// Each worker pops its own queue from the back and steals from the front of the others' queues when idle.
+// Jobs submitted from outside the pool are spread over the worker queues round robin.
+// A worker with nothing to take parks on its own condition variable; a submit wakes the owner of the queue,
+// or an idle worker to steal the job if the owner is busy.
+// Jobs still queued when the pool is destroyed are dropped, the running ones complete.
+class ComputePool
+{
+    struct Worker
+    {
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> jobs;
+        bool idle = false;      // Parked on wake
+        bool poked = false;     // Woken to steal from the others
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::list<std::thread> m_threads;
+
+    std::atomic<size_t> m_pending = 0;
+    std::atomic<size_t> m_idle = 0;
+    std::atomic<size_t> m_next_worker = 0;
+    std::atomic<bool> m_stop = false;
+
+    static thread_local const ComputePool* s_worker_pool;
+    static thread_local size_t s_worker_index;
+
+    std::optional<std::function<void()>> Take(size_t index);
+    void WakeIdle(size_t except);
+    void Run(size_t index);
+
+public:
+    explicit ComputePool(size_t threads, const std::vector<int>& cpus = {});
+    ~ComputePool();
+
+    ComputePool(const ComputePool&) = delete;
+    ComputePool& operator=(const ComputePool&) = delete;
+
+    void Submit(std::function<void()> job);
+
+    size_t Threads() const { return m_workers.size(); }
+    size_t Pending() const { return m_pending.load(std::memory_order_relaxed); }
+};
+
+// Runs Asio handlers either on a pool of threads sharing a single io_context,
+// or in thread-per-core mode: an io_context per thread, each thread pinned to its own CPU.
+// In thread-per-core mode handlers of a shard never leave its core, so there is no contention
+// on the context's internal locks and the shard's data stays in that core's cache.
 class AsioScheduler: public std::enable_shared_from_this<AsioScheduler> {
-    io_context m_io_ctx;
+    struct Shard
+    {
+        io_context io;
+        boost::asio::executor_work_guard<io_context::executor_type> guard;
+#ifdef BOOST_ASIO_HAS_IO_URING
+        RegisteredBufferPool read_buffers;
+#endif
+        explicit Shard(int concurrency_hint);
+    };
+
+    // Shared with the threads running them, see the destructor
+    std::vector<std::shared_ptr<Shard>> m_shards;
     ssl::context m_ssl_ctx;
-    boost::asio::executor_work_guard<io_context::executor_type> m_io_guard;
     std::list<std::thread> m_threads;
+
+    std::once_flag m_compute_once;
+    std::unique_ptr<ComputePool> m_compute;
+
+    void Start(size_t threads, const std::vector<int>& cpus);
+
 public:
-    AsioScheduler();
+    explicit AsioScheduler(size_t shards = 1);
     virtual ~AsioScheduler();
 
-    static std::shared_ptr<AsioScheduler> Create(size_t threads);
+    // A pool of threads sharing one io_context, threads are pinned to the CPUs given (if any) in order
+    static std::shared_ptr<AsioScheduler> Create(size_t threads, const std::vector<int>& cpus = {});
+    // One io_context per thread, thread i is pinned to cpus[i] if given
+    static std::shared_ptr<AsioScheduler> CreatePerCore(size_t threads, const std::vector<int>& cpus = {});
+
+    // I/O backend Asio is built with
+    static const char* Backend();
 
-    io_context& io() {return m_io_ctx; }
+    size_t Shards() const { return m_shards.size(); }
+
+    // A fixed shard for the key (e.g. a stream or a symbol), so everything related to it runs on the same core.
+    // Shard 0 is left to control work (HTTP requests, clock sync) when there are more shards than one.
+    size_t ShardFor(std::string_view key) const;
+
+    io_context& io() {return m_shards.front()->io; }
+    io_context& io(size_t shard) {return m_shards[shard % m_shards.size()]->io; }
     ssl::context& ssl() {return m_ssl_ctx; }
+
+    // Starts the compute pool, must be called before the first compute() call to take effect
+    void StartCompute(size_t threads, const std::vector<int>& cpus = {});
+    // Compute pool next to the I/O contexts, started with a single thread if StartCompute() was not called
+    ComputePool& compute();
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    // Buffers are registered per io_uring instance, so each shard has its own pool
+    RegisteredBufferPool& read_buffers(size_t shard = 0) { return m_shards[shard % m_shards.size()]->read_buffers; }
+#endif
 };
 }
 
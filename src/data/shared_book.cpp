@@ -0,0 +1,49 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "shared_book.hpp"
+
+#include <cstring>
+#include <new>
+
+namespace scratcher {
+
+SharedBookPublisher::SharedBookPublisher(const std::string& symbol, size_t depth)
+    : m_name(Name(symbol))
+{
+    if (depth == 0 || depth > SharedBookImage::MAX_DEPTH)
+        throw std::invalid_argument("Shared book depth must be 1.." + std::to_string(SharedBookImage::MAX_DEPTH));
+
+    // A region left by a crashed run would have a stale sequence
+    boost::interprocess::shared_memory_object::remove(m_name.c_str());
+    m_shm = boost::interprocess::shared_memory_object(boost::interprocess::create_only, m_name.c_str(), boost::interprocess::read_write);
+    m_shm.truncate(sizeof(SharedBookRegion));
+    m_region = boost::interprocess::mapped_region(m_shm, boost::interprocess::read_write);
+
+    m_book = new (m_region.get_address()) SharedBookRegion {};
+    std::memcpy(m_book->magic, SharedBookRegion::MAGIC, sizeof(m_book->magic));
+    m_book->version = SharedBookRegion::VERSION;
+    m_book->depth = static_cast<uint32_t>(depth);
+    std::strncpy(m_book->symbol, symbol.c_str(), sizeof(m_book->symbol));
+}
+
+SharedBookPublisher::~SharedBookPublisher()
+{
+    boost::interprocess::shared_memory_object::remove(m_name.c_str());
+}
+
+SharedBookReader::SharedBookReader(const std::string& symbol)
+    : m_shm(boost::interprocess::open_only, SharedBookPublisher::Name(symbol).c_str(), boost::interprocess::read_only)
+    , m_region(m_shm, boost::interprocess::read_only)
+{
+    if (m_region.get_size() < sizeof(SharedBookRegion)) throw std::runtime_error("Truncated shared book region");
+
+    m_book = static_cast<const SharedBookRegion*>(m_region.get_address());
+    if (std::memcmp(m_book->magic, SharedBookRegion::MAGIC, sizeof(m_book->magic)) != 0 || m_book->version != SharedBookRegion::VERSION)
+        throw std::runtime_error("Wrong shared book region header");
+}
+
+}
@@ -0,0 +1,105 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef SHARED_BOOK_HPP
+#define SHARED_BOOK_HPP
+
+#include "data_provider.hpp"
+#include "seqlock.hpp"
+
+#include <cstddef>
+#include <string>
+
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace scratcher {
+
+// Top levels of an order book in a fixed layout of 64-bit little-endian words
+struct SharedBookImage
+{
+    static constexpr size_t MAX_DEPTH = 50;
+
+    uint64_t update_id;
+    int64_t time_ns;            // Unix time the update was applied
+    uint32_t price_decimals;    // price = price_points / 10^price_decimals
+    uint32_t volume_decimals;
+    uint32_t bid_count;
+    uint32_t ask_count;
+    BookLevel bids[MAX_DEPTH];  // Best first
+    BookLevel asks[MAX_DEPTH];
+};
+
+// Shared memory region layout. A reader in any language:
+//   1. reads seq, retries while it is odd;
+//   2. copies the image words;
+//   3. reads seq again and retries if it has changed.
+struct SharedBookRegion
+{
+    static constexpr char MAGIC[8] = "SCRBOOK";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t depth;         // Levels filled per side at most
+    char symbol[16];
+    Seqlock<SharedBookImage> book; // uint64 seq followed by the image
+};
+
+// Mirrors the top of an order book to the named POSIX shared memory object /scratcher.<symbol>.book
+// The region is recreated on start and removed on destruction, readers keep the mapping they have until unmap.
+class SharedBookPublisher
+{
+    const std::string m_name;
+    boost::interprocess::shared_memory_object m_shm;
+    boost::interprocess::mapped_region m_region;
+    SharedBookRegion* m_book;
+
+public:
+    SharedBookPublisher(const std::string& symbol, size_t depth);
+    ~SharedBookPublisher();
+
+    SharedBookPublisher(const SharedBookPublisher&) = delete;
+    SharedBookPublisher& operator=(const SharedBookPublisher&) = delete;
+
+    static std::string Name(const std::string& symbol)
+    { return "scratcher." + symbol + ".book"; }
+
+    size_t Depth() const
+    { return m_book->depth; }
+
+    // Never waits for the readers, must be called from one thread at a time.
+    // Only the configured depth of each side is stored, the levels below it are never written
+    void Publish(const SharedBookImage& image)
+    {
+        size_t levels = m_book->depth * sizeof(BookLevel);
+        m_book->book.Store(image, {{0, offsetof(SharedBookImage, bids)},
+                                   {offsetof(SharedBookImage, bids), levels},
+                                   {offsetof(SharedBookImage, asks), levels}});
+    }
+};
+
+// Read side for C++ processes
+class SharedBookReader
+{
+    boost::interprocess::shared_memory_object m_shm;
+    boost::interprocess::mapped_region m_region;
+    const SharedBookRegion* m_book;
+
+public:
+    // Throws if the publisher has not created the region
+    explicit SharedBookReader(const std::string& symbol);
+
+    SharedBookImage Load() const
+    { return m_book->book.Load(); }
+
+    uint64_t Version() const
+    { return m_book->book.Version(); }
+};
+
+}
+
+#endif //SHARED_BOOK_HPP
@@ -0,0 +1,75 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "socket_options.hpp"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/net_tstamp.h>
+#endif
+
+namespace scratcher {
+
+namespace {
+
+template <typename T>
+void set_option(boost::asio::ip::tcp::socket& socket, int level, int name, T value, const char* title)
+{
+    if (::setsockopt(socket.native_handle(), level, name, &value, sizeof(value)) != 0)
+        std::cerr << "Failed to set socket option " << title << ": " << std::system_category().message(errno) << std::endl;
+}
+
+}
+
+void ApplyBufferSizes(boost::asio::ip::tcp::socket& socket, const SocketOptions& options)
+{
+    boost::system::error_code ec;
+
+    if (options.receive_buffer) {
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(options.receive_buffer), ec);
+        if (ec) std::cerr << "Failed to set socket option SO_RCVBUF: " << ec.message() << std::endl;
+    }
+    if (options.send_buffer) {
+        socket.set_option(boost::asio::socket_base::send_buffer_size(options.send_buffer), ec);
+        if (ec) std::cerr << "Failed to set socket option SO_SNDBUF: " << ec.message() << std::endl;
+    }
+}
+
+void ApplySocketOptions(boost::asio::ip::tcp::socket& socket, const SocketOptions& options)
+{
+    boost::system::error_code ec;
+
+    socket.set_option(boost::asio::ip::tcp::no_delay(options.tcp_nodelay), ec);
+    if (ec) std::cerr << "Failed to set socket option TCP_NODELAY: " << ec.message() << std::endl;
+
+#ifdef __linux__
+    if (options.busy_poll)
+        set_option(socket, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll, "SO_BUSY_POLL");
+
+    if (options.tcp_quickack)
+        set_option(socket, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+
+    if (options.rx_timestamps)
+        set_option(socket, SOL_SOCKET, SO_TIMESTAMPING, SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE, "SO_TIMESTAMPING");
+#else
+    if (options.busy_poll || options.tcp_quickack || options.rx_timestamps)
+        std::cerr << "SO_BUSY_POLL, TCP_QUICKACK and SO_TIMESTAMPING are supported on Linux only" << std::endl;
+#endif
+}
+
+void RearmQuickAck(boost::asio::ip::tcp::socket& socket)
+{
+#ifdef __linux__
+    int value = 1;
+    ::setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &value, sizeof(value));
+#endif
+}
+
+}
@@ -0,0 +1,36 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef SOCKET_OPTIONS_HPP
+#define SOCKET_OPTIONS_HPP
+
+#include <boost/asio/ip/tcp.hpp>
+
+namespace scratcher {
+
+struct SocketOptions
+{
+    bool tcp_nodelay = true;
+    int receive_buffer = 0;   // SO_RCVBUF, bytes, 0 keeps the system default
+    int send_buffer = 0;      // SO_SNDBUF, bytes, 0 keeps the system default
+    int busy_poll = 0;        // SO_BUSY_POLL, microseconds, 0 disables
+    bool tcp_quickack = false;
+    bool rx_timestamps = false; // SO_TIMESTAMPING software receive timestamps
+};
+
+// SO_RCVBUF/SO_SNDBUF, applied to the opened socket before connect, since the window scale is negotiated on SYN
+void ApplyBufferSizes(boost::asio::ip::tcp::socket& socket, const SocketOptions& options);
+
+// The rest of the options, applied to the connected socket.
+// Options not supported by the platform are skipped, failures are logged and do not break the connection
+void ApplySocketOptions(boost::asio::ip::tcp::socket& socket, const SocketOptions& options);
+
+// TCP_QUICKACK is reset by the kernel, so it needs to be re-armed after reads
+void RearmQuickAck(boost::asio::ip::tcp::socket& socket);
+
+}
+
+#endif //SOCKET_OPTIONS_HPP
@@ -0,0 +1,285 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "tick_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace scratcher {
+
+namespace {
+
+constexpr size_t TYPE_SLOTS = 16;
+
+// Block payload starts with the sizes of the columns
+struct BlockHeader
+{
+    uint32_t records;
+    uint32_t time_size;
+    uint32_t price_size;
+    uint32_t volume_size;
+};
+
+uint64_t ZigZag(int64_t value)
+{ return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+
+int64_t UnZigZag(uint64_t value)
+{ return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+void PutVarint(std::vector<uint8_t>& out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+const uint8_t* GetVarint(const uint8_t* p, const uint8_t* end, uint64_t& value)
+{
+    // Most of the deltas fit a byte or two, so the loop exits early
+    value = 0;
+    for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return p;
+    }
+    throw std::runtime_error("Corrupted compressed tick block");
+}
+
+}
+
+CompressedSegmentWriter::CompressedSegmentWriter(std::filesystem::path path, const std::string& symbol)
+    : m_path(std::move(path)), m_file(m_path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_file) throw std::runtime_error("Failed to create " + m_path.string());
+
+    CompressedSegmentHeader header {};
+    std::memcpy(header.magic, CompressedSegmentHeader::MAGIC, sizeof(header.magic));
+    header.version = CompressedSegmentHeader::VERSION;
+    header.block_records = BLOCK_RECORDS;
+    std::strncpy(header.symbol, symbol.c_str(), sizeof(header.symbol));
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_offset = sizeof(header);
+
+    m_block.reserve(BLOCK_RECORDS);
+}
+
+void CompressedSegmentWriter::Append(std::span<const JournalRecord> records)
+{
+    while (!records.empty()) {
+        size_t count = std::min(records.size(), BLOCK_RECORDS - m_block.size());
+        m_block.insert(m_block.end(), records.begin(), records.begin() + count);
+        records = records.subspan(count);
+        if (m_block.size() == BLOCK_RECORDS) WriteBlock();
+    }
+}
+
+void CompressedSegmentWriter::WriteBlock()
+{
+    if (m_block.empty()) return;
+
+    std::vector<uint8_t> time_column, price_column, volume_column;
+    time_column.reserve(m_block.size() * 2);
+    price_column.reserve(m_block.size() * 2);
+    volume_column.reserve(m_block.size() * 4);
+
+    CompressedBlockInfo info {m_block.front().time_ns, m_block.front().time_ns, m_offset, static_cast<uint32_t>(m_block.size()), 0};
+
+    int64_t prev_time = 0, prev_delta = 0;
+    uint64_t prev_price[TYPE_SLOTS] = {};
+    for (const auto& record: m_block) {
+        int64_t delta = record.time_ns - prev_time;
+        PutVarint(time_column, ZigZag(delta - prev_delta));
+        prev_time = record.time_ns;
+        prev_delta = delta;
+
+        uint64_t& prev = prev_price[static_cast<size_t>(record.type) % TYPE_SLOTS];
+        PutVarint(price_column, ZigZag(static_cast<int64_t>(record.price_points - prev)));
+        prev = record.price_points;
+
+        PutVarint(volume_column, record.volume_points);
+
+        info.min_time_ns = std::min(info.min_time_ns, record.time_ns);
+        info.max_time_ns = std::max(info.max_time_ns, record.time_ns);
+    }
+
+    BlockHeader header {info.records, static_cast<uint32_t>(time_column.size()), static_cast<uint32_t>(price_column.size()), static_cast<uint32_t>(volume_column.size())};
+
+    m_buffer.clear();
+    m_buffer.resize(sizeof(header));
+    std::memcpy(m_buffer.data(), &header, sizeof(header));
+    for (const auto& record: m_block)
+        m_buffer.push_back(static_cast<uint8_t>(record.type) | static_cast<uint8_t>(record.side) << 4);
+    m_buffer.insert(m_buffer.end(), time_column.begin(), time_column.end());
+    m_buffer.insert(m_buffer.end(), price_column.begin(), price_column.end());
+    m_buffer.insert(m_buffer.end(), volume_column.begin(), volume_column.end());
+
+    info.size = static_cast<uint32_t>(m_buffer.size());
+    m_file.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size());
+    m_offset += m_buffer.size();
+    m_index.push_back(info);
+    m_block.clear();
+}
+
+void CompressedSegmentWriter::AppendBlocks(const CompressedSegmentReader& reader)
+{
+    WriteBlock(); // Records appended before go first
+
+    for (size_t i = 0; i < reader.Blocks().size(); ++i) {
+        auto data = reader.BlockData(i);
+        CompressedBlockInfo info = reader.Blocks()[i];
+        info.offset = m_offset;
+
+        m_file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        m_offset += data.size();
+        m_index.push_back(info);
+    }
+}
+
+void CompressedSegmentWriter::Close()
+{
+    WriteBlock();
+
+    CompressedSegmentFooter footer {m_offset, m_index.size(), {}};
+    std::memcpy(footer.magic, CompressedSegmentFooter::MAGIC, sizeof(footer.magic));
+    m_file.write(reinterpret_cast<const char*>(m_index.data()), m_index.size() * sizeof(CompressedBlockInfo));
+    m_file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+
+    if (!m_file.flush()) throw std::runtime_error("Failed to write " + m_path.string());
+    m_file.close();
+}
+
+CompressedSegmentReader::CompressedSegmentReader(const std::filesystem::path& path)
+    : m_file(path.c_str(), boost::interprocess::read_only)
+    , m_region(m_file, boost::interprocess::read_only)
+{
+    const auto* base = static_cast<const char*>(m_region.get_address());
+    size_t size = m_region.get_size();
+    if (size < sizeof(CompressedSegmentHeader) + sizeof(CompressedSegmentFooter))
+        throw std::runtime_error("Truncated compressed tick segment");
+
+    m_header = reinterpret_cast<const CompressedSegmentHeader*>(base);
+    if (std::memcmp(m_header->magic, CompressedSegmentHeader::MAGIC, sizeof(m_header->magic)) != 0 || m_header->version != CompressedSegmentHeader::VERSION)
+        throw std::runtime_error("Wrong compressed tick segment header");
+
+    // Blocks have arbitrary sizes, so the footer and the index are not aligned in the file and are copied out
+    CompressedSegmentFooter footer;
+    std::memcpy(&footer, base + size - sizeof(footer), sizeof(footer));
+    if (std::memcmp(footer.magic, CompressedSegmentFooter::MAGIC, sizeof(footer.magic)) != 0)
+        throw std::runtime_error("Compressed tick segment is not complete");
+
+    // The footer values come from the file, so the arithmetic must not wrap
+    uint64_t index_end = size - sizeof(footer);
+    if (footer.index_offset < sizeof(CompressedSegmentHeader) || footer.index_offset > index_end ||
+        footer.blocks > (index_end - footer.index_offset) / sizeof(CompressedBlockInfo) ||
+        footer.index_offset + footer.blocks * sizeof(CompressedBlockInfo) != index_end)
+        throw std::runtime_error("Corrupted compressed tick block");
+
+    m_index.resize(footer.blocks);
+    std::memcpy(m_index.data(), base + footer.index_offset, footer.blocks * sizeof(CompressedBlockInfo));
+
+    // Blocks lie between the header and the index
+    for (const auto& info: m_index) {
+        if (info.offset < sizeof(CompressedSegmentHeader) || info.offset > footer.index_offset || info.size > footer.index_offset - info.offset)
+            throw std::runtime_error("Corrupted compressed tick block");
+    }
+}
+
+std::string CompressedSegmentReader::Symbol() const
+{ return std::string(m_header->symbol, strnlen(m_header->symbol, sizeof(m_header->symbol))); }
+
+std::span<const uint8_t> CompressedSegmentReader::BlockData(size_t block) const
+{
+    const CompressedBlockInfo& info = m_index[block];
+    return {static_cast<const uint8_t*>(m_region.get_address()) + info.offset, info.size};
+}
+
+void CompressedSegmentReader::DecodeBlock(size_t block, std::vector<JournalRecord>& records) const
+{
+    const CompressedBlockInfo& info = m_index[block];
+    const auto* p = static_cast<const uint8_t*>(m_region.get_address()) + info.offset;
+    const uint8_t* end = p + info.size;
+
+    BlockHeader header;
+    if (info.size < sizeof(header)) throw std::runtime_error("Corrupted compressed tick block");
+    std::memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+    if (header.records != info.records || sizeof(header) + header.records + header.time_size + header.price_size + header.volume_size != info.size)
+        throw std::runtime_error("Corrupted compressed tick block");
+
+    size_t first = records.size();
+    records.resize(first + header.records);
+    std::span<JournalRecord> out(records.data() + first, header.records);
+
+    for (auto& record: out) {
+        record = {};
+        record.type = static_cast<JournalRecordType>(*p & 0x0f);
+        record.side = static_cast<TradeSide>(*p >> 4);
+        ++p;
+    }
+
+    const uint8_t* column_end = p + header.time_size;
+    int64_t prev_time = 0, prev_delta = 0;
+    for (auto& record: out) {
+        uint64_t value;
+        p = GetVarint(p, column_end, value);
+        prev_delta += UnZigZag(value);
+        prev_time += prev_delta;
+        record.time_ns = prev_time;
+    }
+
+    column_end = p + header.price_size;
+    uint64_t prev_price[TYPE_SLOTS] = {};
+    for (auto& record: out) {
+        uint64_t value;
+        p = GetVarint(p, column_end, value);
+        uint64_t& prev = prev_price[static_cast<size_t>(record.type) % TYPE_SLOTS];
+        prev += static_cast<uint64_t>(UnZigZag(value));
+        record.price_points = prev;
+    }
+
+    for (auto& record: out)
+        p = GetVarint(p, end, record.volume_points);
+}
+
+void CompressedSegmentReader::DecodeAll(std::vector<JournalRecord>& records) const
+{
+    size_t total = records.size();
+    for (const auto& info: m_index) total += info.records;
+    records.reserve(total);
+
+    for (size_t i = 0; i < m_index.size(); ++i)
+        DecodeBlock(i, records);
+}
+
+void CompressSegment(const std::filesystem::path& journal_path, const std::filesystem::path& compressed_path)
+{
+    uint64_t size = std::filesystem::file_size(journal_path);
+    if (size < sizeof(JournalHeader)) throw std::runtime_error("Truncated journal segment " + journal_path.string());
+
+    boost::interprocess::file_mapping file(journal_path.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(file, boost::interprocess::read_only, 0, size);
+
+    std::span<const JournalRecord> records = CommittedRecords(region.get_address(), region.get_size());
+    const auto* header = static_cast<const JournalHeader*>(region.get_address());
+
+    // Written aside and renamed, so a half written file never looks complete
+    std::filesystem::path temp_path = compressed_path;
+    temp_path += ".tmp";
+    CompressedSegmentWriter writer(temp_path, std::string(header->symbol, strnlen(header->symbol, sizeof(header->symbol))));
+
+    // Late records of an already compressed day are merged into it
+    if (std::filesystem::exists(compressed_path))
+        writer.AppendBlocks(CompressedSegmentReader(compressed_path));
+    writer.Append(records);
+    writer.Close();
+    std::filesystem::rename(temp_path, compressed_path);
+}
+
+}
@@ -0,0 +1,120 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef TICK_CODEC_HPP
+#define TICK_CODEC_HPP
+
+#include "journal.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace scratcher {
+
+// Compressed journal segment: <YYYY-MM-DD>.tickz
+//
+// Layout: header, independent blocks of up to BLOCK_RECORDS records, block index, footer.
+// A block keeps every field as a separate column:
+//   kind     - one byte per record: type | side << 4
+//   time     - delta-of-delta, zig-zag varint
+//   price    - delta to the previous record of the same type, zig-zag varint
+//   volume   - varint
+// Each column is decoded by its own tight loop, and a block needs no state of the previous ones,
+// so any block can be decoded alone by the index.
+struct CompressedSegmentHeader
+{
+    static constexpr char MAGIC[8] = "SCRTICZ";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t block_records;
+    char symbol[16];
+};
+static_assert(sizeof(CompressedSegmentHeader) == 32);
+
+struct CompressedBlockInfo
+{
+    int64_t min_time_ns;
+    int64_t max_time_ns;
+    uint64_t offset;        // From the file start
+    uint32_t records;
+    uint32_t size;
+};
+static_assert(sizeof(CompressedBlockInfo) == 32);
+
+struct CompressedSegmentFooter
+{
+    static constexpr char MAGIC[8] = "SCRTEND";
+
+    uint64_t index_offset;
+    uint64_t blocks;
+    char magic[8];
+};
+static_assert(sizeof(CompressedSegmentFooter) == 24);
+
+class CompressedSegmentReader;
+
+class CompressedSegmentWriter
+{
+public:
+    static constexpr uint32_t BLOCK_RECORDS = 4096;
+
+private:
+    std::filesystem::path m_path;
+    std::ofstream m_file;
+    uint64_t m_offset = 0;
+    std::vector<JournalRecord> m_block;
+    std::vector<CompressedBlockInfo> m_index;
+    std::vector<uint8_t> m_buffer;
+
+    void WriteBlock();
+
+public:
+    CompressedSegmentWriter(std::filesystem::path path, const std::string& symbol);
+
+    void Append(std::span<const JournalRecord> records);
+    // Copies the blocks of an existing segment as they are, blocks need no state of the previous ones
+    void AppendBlocks(const CompressedSegmentReader& reader);
+    // Writes the last block and the index, the file is not readable before that
+    void Close();
+};
+
+class CompressedSegmentReader
+{
+    boost::interprocess::file_mapping m_file;
+    boost::interprocess::mapped_region m_region;
+    const CompressedSegmentHeader* m_header;
+    std::vector<CompressedBlockInfo> m_index;
+
+public:
+    explicit CompressedSegmentReader(const std::filesystem::path& path);
+
+    std::string Symbol() const;
+    std::span<const CompressedBlockInfo> Blocks() const
+    { return m_index; }
+
+    // Encoded block as it is in the file
+    std::span<const uint8_t> BlockData(size_t block) const;
+    // Appends the records of the block to the output
+    void DecodeBlock(size_t block, std::vector<JournalRecord>& records) const;
+    void DecodeAll(std::vector<JournalRecord>& records) const;
+};
+
+// Compresses a raw journal segment, the records are appended if the compressed segment exists already:
+// its blocks are copied without decoding and only the new records are encoded.
+// Throws on a read or write failure
+void CompressSegment(const std::filesystem::path& journal_path, const std::filesystem::path& compressed_path);
+
+}
+
+#endif //TICK_CODEC_HPP
@@ -0,0 +1,84 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#include "timestamping_stream.hpp"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#endif
+
+namespace scratcher {
+
+void TimestampingStream::Configure(const SocketOptions& options)
+{
+    ApplySocketOptions(m_next.socket(), options);
+
+#ifdef __linux__
+    m_rx_timestamps = options.rx_timestamps;
+    m_quick_ack = options.tcp_quickack;
+#endif
+}
+
+size_t TimestampingStream::ReceiveSome(const boost::asio::mutable_buffer* buffers, size_t count, boost::system::error_code& ec)
+{
+#ifdef __linux__
+    iovec iov[16];
+    size_t iov_count = 0;
+    for (size_t i = 0; i < count && iov_count < std::size(iov); ++i) {
+        if (buffers[i].size() == 0) continue;
+        iov[iov_count].iov_base = buffers[i].data();
+        iov[iov_count].iov_len = buffers[i].size();
+        ++iov_count;
+    }
+    if (!iov_count) {
+        ec = {};
+        return 0;
+    }
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+    msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov_count;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    CountSocketRead();
+    ssize_t res = ::recvmsg(m_next.socket().native_handle(), &msg, MSG_DONTWAIT);
+    if (res < 0) {
+        ec = boost::system::error_code(errno, boost::asio::error::get_system_category());
+        return 0;
+    }
+    if (res == 0) {
+        ec = boost::asio::error::eof;
+        return 0;
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            scm_timestamping stamps;
+            std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            // ts[0] holds the software timestamp, CLOCK_REALTIME
+            if (stamps.ts[0].tv_sec || stamps.ts[0].tv_nsec) {
+                m_last_rx = time_point(std::chrono::duration_cast<time_point::duration>(std::chrono::seconds(stamps.ts[0].tv_sec) + std::chrono::nanoseconds(stamps.ts[0].tv_nsec)));
+                if (!m_first_rx) m_first_rx = m_last_rx;
+            }
+        }
+    }
+
+    AfterSocketRead();
+
+    ec = {};
+    return static_cast<size_t>(res);
+#else
+    ec = boost::asio::error::operation_not_supported;
+    return 0;
+#endif
+}
+
+}
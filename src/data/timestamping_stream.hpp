@@ -0,0 +1,300 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+#ifndef TIMESTAMPING_STREAM_HPP
+#define TIMESTAMPING_STREAM_HPP
+
+#include <chrono>
+#include <optional>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket/teardown.hpp>
+
+#include "socket_options.hpp"
+#include "scheduler.hpp"
+
+namespace scratcher {
+
+// TCP stream layer which reads with recvmsg() to pick up SO_TIMESTAMPING kernel receive timestamps.
+// It goes under the TLS layer, so the time a websocket frame has reached the host
+// can be told apart from the time it took to decrypt and decode it.
+// Without rx_timestamps enabled (or on non-Linux platforms) reads are forwarded to tcp_stream as is.
+class TimestampingStream
+{
+public:
+    typedef boost::beast::tcp_stream next_layer_type;
+    typedef next_layer_type::executor_type executor_type;
+    typedef next_layer_type::socket_type lowest_layer_type; // Required by asio::ssl::stream
+    typedef std::chrono::system_clock::time_point time_point;
+
+private:
+    next_layer_type m_next;
+
+    bool m_rx_timestamps = false;
+    bool m_quick_ack = false;
+
+    std::optional<time_point> m_first_rx; // The first kernel timestamp since the last TakeReceiveTime()
+    std::optional<time_point> m_last_rx;
+    std::atomic<uint64_t> m_socket_reads = 0; // recv/recvmsg syscalls and io_uring read/poll submissions
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    RegisteredBufferPool* m_buffer_pool = nullptr;
+    std::optional<size_t> m_buffer_index;
+    size_t m_buffered_begin = 0;
+    size_t m_buffered_end = 0;
+
+    template <typename MutableBufferSequence>
+    size_t CopyBuffered(const MutableBufferSequence& buffers)
+    {
+        const auto& registered = (*m_buffer_pool)[*m_buffer_index];
+        size_t size = boost::asio::buffer_copy(buffers, boost::asio::buffer(static_cast<char*>(registered.data()) + m_buffered_begin, m_buffered_end - m_buffered_begin));
+        m_buffered_begin += size;
+        return size;
+    }
+
+    // Reads into the registered buffer and serves the caller from it
+    template <typename MutableBufferSequence>
+    struct read_registered_op
+    {
+        TimestampingStream& stream;
+        MutableBufferSequence buffers;
+        bool started = false;
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, size_t size = 0)
+        {
+            if (!started) {
+                started = true;
+                if (stream.m_buffered_begin != stream.m_buffered_end)
+                    boost::asio::post(stream.get_executor(), std::move(self));
+                else {
+                    stream.CountSocketRead();
+                    stream.m_next.socket().async_read_some((*stream.m_buffer_pool)[*stream.m_buffer_index], std::move(self));
+                }
+                return;
+            }
+            if (ec) {
+                self.complete(ec, 0);
+                return;
+            }
+            if (size) {
+                stream.m_buffered_begin = 0;
+                stream.m_buffered_end = size;
+                stream.AfterSocketRead();
+            }
+            self.complete(ec, stream.CopyBuffered(buffers));
+        }
+    };
+#endif
+
+    // Read by Asio, one io_uring submission each. On the platforms without the own recvmsg() path
+    // the speculative reads of the reactor are not seen, so the count is a lower bound there
+    template <typename MutableBufferSequence>
+    struct read_plain_op
+    {
+        TimestampingStream& stream;
+        MutableBufferSequence buffers;
+        bool started = false;
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, size_t size = 0)
+        {
+            if (!started) {
+                started = true;
+                stream.CountSocketRead();
+                stream.m_next.async_read_some(buffers, std::move(self));
+                return;
+            }
+            if (!ec) stream.AfterSocketRead();
+            self.complete(ec, size);
+        }
+    };
+
+    void CountSocketRead()
+    { m_socket_reads.fetch_add(1, std::memory_order_relaxed); }
+
+    // TCP_QUICKACK is reset by the kernel, so every path reading the socket re-arms it
+    void AfterSocketRead()
+    {
+        if (m_quick_ack)
+            RearmQuickAck(m_next.socket());
+    }
+
+    // Non-blocking recvmsg() into the buffers, would_block is returned if no data is available yet
+    size_t ReceiveSome(const boost::asio::mutable_buffer* buffers, size_t count, boost::system::error_code& ec);
+
+    template <typename MutableBufferSequence>
+    size_t ReceiveSome(const MutableBufferSequence& buffers, boost::system::error_code& ec)
+    {
+        constexpr size_t MAX_BUFFERS = 16;
+        boost::asio::mutable_buffer array[MAX_BUFFERS];
+        size_t count = 0;
+        for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers) && count < MAX_BUFFERS; ++it)
+            array[count++] = boost::asio::mutable_buffer(*it);
+
+        return ReceiveSome(array, count, ec);
+    }
+
+    // recvmsg() issued by the stream itself, so each syscall is counted. The first one is speculative as in Asio reactor,
+    // the socket readiness is awaited only if there is no data yet
+    template <typename MutableBufferSequence>
+    struct read_some_op
+    {
+        TimestampingStream& stream;
+        MutableBufferSequence buffers;
+        bool started = false;
+        bool done = false;
+        boost::system::error_code result_ec;
+        size_t result_size = 0;
+
+        static bool WouldBlock(const boost::system::error_code& ec)
+        { return ec == boost::asio::error::would_block || ec == boost::asio::error::try_again; }
+
+        template <typename Self>
+        void Wait(Self& self)
+        {
+#ifdef BOOST_ASIO_HAS_IO_URING
+            stream.CountSocketRead(); // Poll submission
+#endif
+            stream.m_next.socket().async_wait(boost::asio::socket_base::wait_read, std::move(self));
+        }
+
+        template <typename Self>
+        void operator()(Self& self, boost::system::error_code ec = {}, size_t size = 0)
+        {
+            if (done) {
+                self.complete(result_ec, result_size);
+                return;
+            }
+            if (!started) {
+                started = true;
+                size = stream.ReceiveSome(buffers, ec);
+                if (WouldBlock(ec)) {
+                    Wait(self);
+                    return;
+                }
+                // Never complete from within the initiating function
+                done = true;
+                result_ec = ec;
+                result_size = size;
+                boost::asio::post(stream.get_executor(), std::move(self));
+                return;
+            }
+            if (!ec) {
+                size = stream.ReceiveSome(buffers, ec);
+                if (WouldBlock(ec)) {
+                    Wait(self);
+                    return;
+                }
+                self.complete(ec, size);
+                return;
+            }
+            self.complete(ec, 0);
+        }
+    };
+
+public:
+    template <typename... Args>
+    explicit TimestampingStream(Args&&... args) : m_next(std::forward<Args>(args)...) {}
+
+    TimestampingStream(const TimestampingStream&) = delete;
+    TimestampingStream& operator=(const TimestampingStream&) = delete;
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    ~TimestampingStream()
+    { if (m_buffer_index) m_buffer_pool->Release(*m_buffer_index); }
+
+    // Plain (not timestamped) reads go through a registered buffer if the pool has a free one
+    void UseRegisteredBuffers(RegisteredBufferPool& pool)
+    {
+        if (m_buffer_index) return;
+        m_buffer_pool = &pool;
+        m_buffer_index = pool.Acquire();
+    }
+#endif
+
+    executor_type get_executor() noexcept
+    { return m_next.get_executor(); }
+
+    next_layer_type& next_layer() noexcept
+    { return m_next; }
+    const next_layer_type& next_layer() const noexcept
+    { return m_next; }
+
+    lowest_layer_type& lowest_layer() noexcept
+    { return m_next.socket(); }
+    const lowest_layer_type& lowest_layer() const noexcept
+    { return m_next.socket(); }
+
+    // Applies the options to the connected socket and switches kernel timestamps reading on if requested
+    void Configure(const SocketOptions& options);
+
+    // Kernel receive time of the data read since the previous call, or the latest known one if there were no reads
+    std::optional<time_point> TakeReceiveTime()
+    {
+        auto res = m_first_rx ? m_first_rx : m_last_rx;
+        m_first_rx.reset();
+        return res;
+    }
+
+    // Kernel read calls made so far: recv/recvmsg syscalls or io_uring submissions, reads served from the registered
+    // buffer are not counted. Compared with decoded frames gives syscalls per message
+    uint64_t SocketReads() const
+    { return m_socket_reads.load(std::memory_order_relaxed); }
+
+    // Synchronous operations are used on close only, so no timestamps are taken there
+    template <typename MutableBufferSequence>
+    size_t read_some(const MutableBufferSequence& buffers)
+    { return m_next.read_some(buffers); }
+    template <typename MutableBufferSequence>
+    size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec)
+    { return m_next.read_some(buffers, ec); }
+
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers)
+    { return m_next.write_some(buffers); }
+    template <typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec)
+    { return m_next.write_some(buffers, ec); }
+
+    template <typename MutableBufferSequence, typename ReadHandler>
+    auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler)
+    {
+        if (m_rx_timestamps)
+            return boost::asio::async_compose<ReadHandler, void(boost::system::error_code, size_t)>(
+                read_some_op<MutableBufferSequence>{*this, buffers}, handler, m_next.socket());
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+        if (m_buffer_index)
+            return boost::asio::async_compose<ReadHandler, void(boost::system::error_code, size_t)>(
+                read_registered_op<MutableBufferSequence>{*this, buffers}, handler, m_next.socket());
+#elif defined(__linux__)
+        // The same syscalls as the reactor would make, but counted
+        return boost::asio::async_compose<ReadHandler, void(boost::system::error_code, size_t)>(
+            read_some_op<MutableBufferSequence>{*this, buffers}, handler, m_next.socket());
+#endif
+
+        return boost::asio::async_compose<ReadHandler, void(boost::system::error_code, size_t)>(
+            read_plain_op<MutableBufferSequence>{*this, buffers}, handler, m_next.socket());
+    }
+
+    template <typename ConstBufferSequence, typename WriteHandler>
+    auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler)
+    { return m_next.async_write_some(buffers, std::forward<WriteHandler>(handler)); }
+};
+
+// Websocket close over the plain stream, found by ADL. Not needed under TLS, which tears down itself
+inline void teardown(boost::beast::role_type role, TimestampingStream& stream, boost::system::error_code& ec)
+{ boost::beast::websocket::teardown(role, stream.lowest_layer(), ec); }
+
+template <typename TeardownHandler>
+void async_teardown(boost::beast::role_type role, TimestampingStream& stream, TeardownHandler&& handler)
+{ boost::beast::websocket::async_teardown(role, stream.lowest_layer(), std::forward<TeardownHandler>(handler)); }
+
+}
+
+#endif //TIMESTAMPING_STREAM_HPP
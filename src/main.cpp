@@ -18,11 +18,14 @@ int main(int argc, char *argv[])
 
         auto config = std::make_shared<Config>(argc, argv);
 
-        auto scheduler = scratcher::AsioScheduler::Create(2);
+        auto scheduler = config->ThreadPerCore()
+            ? scratcher::AsioScheduler::CreatePerCore(config->Threads(), config->Cpus())
+            : scratcher::AsioScheduler::Create(config->Threads(), config->Cpus());
+        scheduler->StartCompute(config->ComputeThreads(), config->ComputeCpus());
 
         auto bybit = scratcher::bybit::ByBitApi::Create(config, scheduler);
 
-        MainWindow w(bybit, scheduler);
+        MainWindow w(bybit, scheduler, config->Symbols().front());
         w.show();
         return a.exec();
     }
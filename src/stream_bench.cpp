@@ -0,0 +1,151 @@
+// Scratcher project
+// Copyright (c) 2025 l2xl (l2xl/at/proton.me)
+// Distributed under the MIT software license, see the accompanying
+// file LICENSE or https://opensource.org/license/mit
+//
+
+// Websocket read path benchmark: a loopback server sends timestamped messages at a fixed rate and the client reads
+// them through TimestampingStream as the public stream does (without TLS). Reports socket read syscalls per message
+// and the send to decode latency. The backend is chosen at build time, so epoll and io_uring are compared by running
+// the builds with and without EXSCRATCHER_IO_URING.
+
+#include "cli11/CLI11.hpp"
+
+#include "timestamping_stream.hpp"
+#include "latency_histogram.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/beast/websocket.hpp>
+
+namespace {
+
+using namespace scratcher;
+namespace websocket = boost::beast::websocket;
+using boost::asio::ip::tcp;
+using boost::asio::use_awaitable;
+
+struct BenchOptions
+{
+    size_t messages = 100000;
+    size_t size = 512;
+    unsigned rate = 10000; // messages per second, 0 sends back to back
+    SocketOptions socket;
+    bool registered_buffers = false;
+};
+
+int64_t SteadyNowNs()
+{ return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+boost::asio::awaitable<void> Serve(tcp::acceptor& acceptor, const BenchOptions& options)
+{
+    websocket::stream<boost::beast::tcp_stream> ws(co_await acceptor.async_accept(use_awaitable));
+    co_await ws.async_accept(use_awaitable);
+    ws.binary(true);
+
+    boost::asio::steady_timer timer(ws.get_executor());
+    std::vector<char> message(std::max(options.size, sizeof(int64_t)), 'x');
+    auto interval = options.rate ? std::chrono::nanoseconds(std::chrono::seconds(1)) / options.rate : std::chrono::nanoseconds(0);
+    auto next = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < options.messages; ++i) {
+        if (options.rate) {
+            next += interval;
+            timer.expires_at(next);
+            co_await timer.async_wait(use_awaitable);
+        }
+        int64_t sent = SteadyNowNs();
+        std::memcpy(message.data(), &sent, sizeof(sent));
+        co_await ws.async_write(boost::asio::buffer(message), use_awaitable);
+    }
+    co_await ws.async_close(websocket::close_code::normal, use_awaitable);
+}
+
+boost::asio::awaitable<void> Read(tcp::endpoint endpoint, const BenchOptions& options, LatencyHistogram& latency, uint64_t& socket_reads)
+{
+    auto executor = co_await boost::asio::this_coro::executor;
+    websocket::stream<TimestampingStream> ws(executor);
+
+    tcp::socket& socket = ws.next_layer().lowest_layer();
+    socket.open(endpoint.protocol());
+    ApplyBufferSizes(socket, options.socket);
+    co_await socket.async_connect(endpoint, use_awaitable);
+    ws.next_layer().Configure(options.socket);
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+    std::optional<RegisteredBufferPool> pool;
+    if (options.registered_buffers && !options.socket.rx_timestamps) {
+        pool.emplace(static_cast<boost::asio::io_context&>(executor.context()));
+        ws.next_layer().UseRegisteredBuffers(*pool);
+    }
+#endif
+
+    co_await ws.async_handshake(endpoint.address().to_string(), "/", use_awaitable);
+    uint64_t handshake_reads = ws.next_layer().SocketReads();
+
+    boost::beast::flat_buffer buffer;
+    for (size_t i = 0; i < options.messages; ++i) {
+        co_await ws.async_read(buffer, use_awaitable);
+        int64_t sent;
+        std::memcpy(&sent, buffer.data().data(), sizeof(sent));
+        latency.Record(std::chrono::nanoseconds(SteadyNowNs() - sent));
+        buffer.consume(buffer.size());
+    }
+    socket_reads = ws.next_layer().SocketReads() - handshake_reads;
+
+    boost::system::error_code ec;
+    co_await ws.async_read(buffer, boost::asio::redirect_error(use_awaitable, ec)); // The server close frame
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+
+    CLI::App app("Websocket stream read benchmark");
+    app.add_option("--messages", options.messages, "Number of messages")->capture_default_str();
+    app.add_option("--size", options.size, "Message size, bytes")->capture_default_str();
+    app.add_option("--rate", options.rate, "Messages per second, 0 sends back to back")->capture_default_str();
+    app.add_option("--so-rcvbuf", options.socket.receive_buffer, "SO_RCVBUF, bytes, 0 keeps the system default");
+    app.add_option("--busy-poll", options.socket.busy_poll, "SO_BUSY_POLL, microseconds");
+    app.add_flag("--quickack", options.socket.tcp_quickack, "Re-arm TCP_QUICKACK after reads");
+    app.add_flag("--rx-timestamps", options.socket.rx_timestamps, "Read SO_TIMESTAMPING receive times");
+    app.add_flag("--registered-buffers", options.registered_buffers, "Read through io_uring registered buffers");
+    CLI11_PARSE(app, argc, argv);
+
+    try {
+        boost::asio::io_context io(1);
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+        LatencyHistogram latency;
+        uint64_t socket_reads = 0;
+
+        auto rethrow = [](std::exception_ptr e) { if (e) std::rethrow_exception(e); };
+        boost::asio::co_spawn(io, Serve(acceptor, options), rethrow);
+        boost::asio::co_spawn(io, Read(acceptor.local_endpoint(), options, latency, socket_reads), rethrow);
+        io.run();
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+        const char* backend = "io_uring";
+#else
+        const char* backend = "epoll";
+#endif
+        auto snap = latency.Snap();
+        std::cout << "backend: " << backend
+                  << " messages: " << snap.Count()
+                  << " syscalls per message: " << (snap.Count() ? double(socket_reads) / snap.Count() : 0.0)
+                  << " latency p50: " << std::chrono::duration_cast<std::chrono::microseconds>(snap.Percentile(50))
+                  << " p99: " << std::chrono::duration_cast<std::chrono::microseconds>(snap.Percentile(99))
+                  << " max: " << std::chrono::duration_cast<std::chrono::microseconds>(snap.Max()) << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}